@@ -2,6 +2,7 @@
 #define __GRAPH_EULER__
 
 #include "traverse.h"
+#include "snapshot.h"
 
 
 class CGraphEuler
@@ -25,9 +26,9 @@ public:
 		if(m_type == PathNone)
 			return;
 
-		// Make a copy of the passed graph because
+		// Work on a snapshot of the passed graph because
 		// the method removes edges as they are processed.
-		G g(f_g);
+		typename graph_snapshot<G>::type g(f_g);
 
 		/**
 		 * 1. Take any simple path;
@@ -205,5 +205,124 @@ private:
 	std::vector<Edge*> m_vertices;
 };
 
+// ============================================================================
+// Compressed Sparse Row Graph (immutable)
+class CSGraph : public CGraph
+{
+	friend class CGraphBuilder;
+	friend class CSGraphSnapshot;
+
+	// Iterator
+public:
+	class AdjIterator
+	{
+		friend class CSGraph;
+	public:
+		AdjIterator& operator++() { ++m_cur; return *this; }
+		unsigned operator*() const { return *m_cur; }
+		bool operator!=(const AdjIterator& f_it) const { return (m_cur != f_it.m_cur); }
+		bool operator==(const AdjIterator& f_it) const { return (m_cur == f_it.m_cur); }
+	private:
+		AdjIterator(const unsigned* f_p): m_cur(f_p) {}
+	private:
+		const unsigned* m_cur;
+	};
+
+	AdjIterator begin(unsigned f_v) const { return AdjIterator((f_v < V()) ? m_adj.data() + m_offset[f_v]     : NULL); }
+	AdjIterator   end(unsigned f_v) const { return AdjIterator((f_v < V()) ? m_adj.data() + m_offset[f_v + 1] : NULL); }
+
+	// ================================
+public:
+	// Flatten any graph exposing the AdjIterator interface
+	template<class G>
+	explicit CSGraph(const G& f_g):
+		CGraph(f_g.V()),
+		m_offset(f_g.V() + 1)
+	{
+		unsigned n = V();
+		for(unsigned v = 0; v < n; v++)
+		{
+			m_degree[v] = f_g.degree(v);
+			m_offset[v + 1] = m_offset[v] + m_degree[v];
+		}
+		m_adj.resize(m_offset[n]);
+		for(unsigned v = 0; v < n; v++)
+		{
+			unsigned* p = m_adj.data() + m_offset[v];
+			for(typename G::AdjIterator it = f_g.begin(v), end = f_g.end(v); it != end; ++it)
+				*p++ = *it;
+		}
+		m_E = f_g.E();
+		pair_slots();
+	}
+
+private:
+	CSGraph(unsigned f_V): CGraph(f_V), m_offset(f_V + 1) {}
+
+	// m_twin[s] is the slot of the same edge seen from its other end. The k-th
+	// v->w slot of v is paired with the k-th w->v slot of w (the pairing of
+	// CEGraph::insert()), the two slots of a self-loop with each other.
+	// Two counting sorts over the slots, O(V + E).
+	void pair_slots()
+	{
+		unsigned n = V();
+		unsigned m = m_adj.size();
+		// The slots targeting w by source: the graph is symmetric, so these
+		// lists have the same offsets as the adjacency lists
+		std::vector<unsigned> at(m_offset.begin(), m_offset.end() - 1);
+		std::vector<unsigned> in(m), from(m);
+		for(unsigned v = 0; v < n; v++)
+		{
+			for(unsigned s = m_offset[v]; s < m_offset[v + 1]; s++)
+			{
+				unsigned i = at[m_adj[s]]++;
+				in[i] = s;
+				from[i] = v;
+			}
+		}
+		// The slots of v by target
+		std::vector<unsigned> out(m);
+		at.assign(m_offset.begin(), m_offset.end() - 1);
+		for(unsigned i = 0; i < m; i++)
+			out[at[from[i]]++] = in[i];
+
+		m_twin.resize(m);
+		for(unsigned v = 0; v < n; v++)
+		{
+			for(unsigned i = m_offset[v], end = m_offset[v + 1]; i < end; i++)
+			{
+				unsigned s = out[i];
+				if(m_adj[s] != v)
+					m_twin[s] = in[i];
+				else if((i + 1 < end) && (m_adj[out[i + 1]] == v))
+				{
+					m_twin[s] = out[i + 1];
+					m_twin[out[++i]] = s;
+				}
+				else
+					m_twin[s] = s;
+			}
+		}
+	}
+
+	void print(std::ostream& f_os) const
+	{
+		for(unsigned v = 0, n = V(); v < n; v++)
+		{
+			f_os << v << ':';
+			for(AdjIterator it = begin(v), end = this->end(v); it != end; ++it)
+				f_os << ' ' << *it;
+			f_os << std::endl;
+		}
+	}
+
+private:
+	// m_adj[m_offset[v] .. m_offset[v + 1]) are the vertices linked to v
+	std::vector<unsigned> m_offset;
+	std::vector<unsigned> m_adj;
+	// Reverse slot of every adjacency slot (see pair_slots())
+	std::vector<unsigned> m_twin;
+};
+
 #endif // __GRAPH_BASE__
 
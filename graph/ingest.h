@@ -0,0 +1,161 @@
+#ifndef __GRAPH_INGEST__
+#define __GRAPH_INGEST__
+
+#include <atomic>
+#include <new>
+#include <thread>
+#include <stdint.h>
+
+#include "graph.h"
+
+
+// ============================================================================
+// Concurrent Graph Builder
+//
+// Any number of threads may call insert() at once: every vertex owns a
+// spinlock and a list of cache-line sized chunks its neighbours are appended
+// to, so threads only contend when they hit the same vertex. There is no
+// shared counter, and every vertex has a cache line of its own, so the
+// threads appending to neighbouring vertices do not share the lines of
+// their locks either. E() and freeze() must be called after all the
+// inserting threads are done.
+class CGraphBuilder
+{
+public:
+	CGraphBuilder(unsigned f_V): m_V(f_V), m_buf(new char[(f_V + 1) * sizeof(Vertex)])
+	{
+		uintptr_t p = (uintptr_t)m_buf;
+		m_vertices = (Vertex*)(m_buf + (sizeof(Vertex) - p % sizeof(Vertex)) % sizeof(Vertex));
+		for(unsigned v = 0; v < f_V; v++)
+			new(&m_vertices[v]) Vertex();
+	}
+	~CGraphBuilder()
+	{
+		for(unsigned v = 0; v < m_V; v++)
+		{
+			for(Chunk* c = m_vertices[v].head; c;)
+			{
+				Chunk* p = c;
+				c = c->next;
+				delete p;
+			}
+		}
+		delete[] m_buf;
+	}
+
+	unsigned V() const { return m_V; }
+	// Both ends of every edge are listed (a self-loop twice at its vertex)
+	unsigned E() const
+	{
+		unsigned long long sum = 0;
+		for(unsigned v = 0; v < m_V; v++)
+			sum += m_vertices[v].degree;
+		return (unsigned)(sum / 2);
+	}
+
+	// Thread-safe
+	void insert(unsigned f_v, unsigned f_w)
+	{
+		if(f_v >= m_V || f_w >= m_V)
+			return;
+		append(m_vertices[f_v], f_w);
+		append(m_vertices[f_w], f_v);
+	}
+
+	// Produce an immutable graph (neighbours keep their per-vertex insertion order)
+	CSGraph freeze() const
+	{
+		CSGraph g(m_V);
+		for(unsigned v = 0; v < m_V; v++)
+		{
+			g.m_degree[v] = m_vertices[v].degree;
+			g.m_offset[v + 1] = g.m_offset[v] + g.m_degree[v];
+		}
+		g.m_adj.resize(g.m_offset[m_V]);
+		for(unsigned v = 0; v < m_V; v++)
+		{
+			unsigned* p = g.m_adj.data() + g.m_offset[v];
+			for(const Chunk* c = m_vertices[v].head; c; c = c->next)
+			{
+				for(unsigned i = 0; i < c->count; i++)
+					*p++ = c->items[i];
+			}
+		}
+		g.m_E = g.m_offset[m_V] / 2;
+		g.pair_slots();
+		return g;
+	}
+
+private:
+	CGraphBuilder(const CGraphBuilder&);
+	CGraphBuilder& operator=(const CGraphBuilder&);
+
+	struct Chunk
+	{
+		// 64 bytes on LP64
+		enum { Capacity = (64 - sizeof(void*) - sizeof(unsigned)) / sizeof(unsigned) };
+		Chunk(): next(NULL), count(0) {}
+
+		Chunk* next;
+		unsigned count;
+		unsigned items[Capacity];
+	};
+
+	struct alignas(64) Vertex
+	{
+		Vertex(): head(NULL), tail(NULL), degree(0) { lock.clear(); }
+
+		std::atomic_flag lock;
+		Chunk* head;
+		Chunk* tail;
+		unsigned degree;
+	};
+
+	static void lock(Vertex& f_v)
+	{
+		while(f_v.lock.test_and_set(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+	static void unlock(Vertex& f_v) { f_v.lock.clear(std::memory_order_release); }
+
+	// A full chunk is replaced by one allocated outside the lock; if
+	// another thread has got there first, that one is used instead
+	static void append(Vertex& f_v, unsigned f_w)
+	{
+		Chunk* fresh = NULL;
+		for(;;)
+		{
+			lock(f_v);
+			Chunk* c = f_v.tail;
+			if(!c || c->count == Chunk::Capacity)
+			{
+				if(!fresh)
+				{
+					unlock(f_v);
+					fresh = new Chunk();
+					continue;
+				}
+				c = fresh;
+				fresh = NULL;
+				if(f_v.tail)
+					f_v.tail->next = c;
+				else
+					f_v.head = c;
+				f_v.tail = c;
+			}
+			c->items[c->count++] = f_w;
+			f_v.degree++;
+			unlock(f_v);
+			break;
+		}
+		delete fresh;
+	}
+
+private:
+	const unsigned m_V;
+	// The vertices, aligned to the cache line
+	char* m_buf;
+	Vertex* m_vertices;
+};
+
+#endif // __GRAPH_INGEST__
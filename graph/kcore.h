@@ -0,0 +1,340 @@
+#ifndef __GRAPH_KCORE__
+#define __GRAPH_KCORE__
+
+#include <atomic>
+#include <algorithm>
+
+#include "graph.h"
+#include "parallel.h"
+
+
+// ============================================================================
+// k-core subgraph: a view over G hiding the vertices with core(v) < k.
+// Vertex numbers are preserved; use CSGraph(view) to materialize it.
+template<class G>
+class CGraphCoreView : public CGraph
+{
+	// Iterator
+public:
+	class AdjIterator
+	{
+		friend class CGraphCoreView;
+	public:
+		AdjIterator& operator++() { ++m_it; skip(); return *this; }
+		unsigned operator*() const { return *m_it; }
+		bool operator!=(const AdjIterator& f_it) const { return (m_it != f_it.m_it); }
+		bool operator==(const AdjIterator& f_it) const { return (m_it == f_it.m_it); }
+	private:
+		AdjIterator(const CGraphCoreView* f_view, typename G::AdjIterator f_it, typename G::AdjIterator f_end):
+			m_view(f_view), m_it(f_it), m_end(f_end)
+		{ skip(); }
+		void skip()
+		{
+			while(m_it != m_end && !m_view->has(*m_it))
+				++m_it;
+		}
+	private:
+		const CGraphCoreView* m_view;
+		typename G::AdjIterator m_it;
+		typename G::AdjIterator m_end;
+	};
+
+	AdjIterator begin(unsigned f_v) const
+	{
+		typename G::AdjIterator end = m_g.end(f_v);
+		return AdjIterator(this, has(f_v) ? m_g.begin(f_v) : end, end);
+	}
+	AdjIterator end(unsigned f_v) const { return AdjIterator(this, m_g.end(f_v), m_g.end(f_v)); }
+
+	// ================================
+public:
+	CGraphCoreView(const G& f_g, const std::vector<unsigned>& f_core, unsigned f_k):
+		CGraph(f_g.V()),
+		m_g(f_g),
+		m_core(f_core),
+		m_k(f_k)
+	{
+		unsigned ends = 0;
+		for(unsigned v = 0, n = V(); v < n; v++)
+		{
+			if(!has(v))
+				continue;
+			for(AdjIterator it = begin(v), end = this->end(v); it != end; ++it)
+				m_degree[v]++;
+			ends += m_degree[v];
+		}
+		m_E = ends / 2;
+	}
+
+	bool has(unsigned f_v) const { return (f_v < V() && m_core[f_v] >= m_k); }
+
+private:
+	void print(std::ostream& f_os) const
+	{
+		for(unsigned v = 0, n = V(); v < n; v++)
+		{
+			if(!has(v))
+				continue;
+			f_os << v << ':';
+			for(AdjIterator it = begin(v), end = this->end(v); it != end; ++it)
+				f_os << ' ' << *it;
+			f_os << std::endl;
+		}
+	}
+
+private:
+	const G& m_g;
+	const std::vector<unsigned>& m_core;
+	const unsigned m_k;
+};
+
+// ============================================================================
+// k-core decomposition: core(v) is the largest k such that v belongs to
+// a subgraph where every vertex has at least k neighbours.
+//
+// Sequential: Batagelj-Zaversnik bucket queue, O(V + E).
+// Parallel:   level-synchronous peeling; all the vertices with degree k are
+//             removed in parallel, the ones dropping to k join the level.
+//             The levels are driven by per-thread degree buckets, so the
+//             work is O(V + E) plus a barrier per round.
+enum { CoreWindow = 64 };	// the degrees bucketed at first
+static const unsigned NoCore = ~0u;
+
+class CGraphCore
+{
+public:
+	template<class G>
+	CGraphCore(const G& f_g, unsigned f_threads = 1):
+		m_core(f_g.V()),
+		m_max(0)
+	{
+		if(f_threads > 1)
+			peel(f_g, f_threads);
+		else
+			bucket(f_g);
+
+		for(unsigned v = 0, n = m_core.size(); v < n; v++)
+		{
+			if(m_core[v] > m_max)
+				m_max = m_core[v];
+		}
+	}
+
+	unsigned core(unsigned f_v) const { return m_core.at(f_v); }
+	unsigned degeneracy() const { return m_max; }
+
+	template<class G>
+	CGraphCoreView<G> subgraph(const G& f_g, unsigned f_k) const { return CGraphCoreView<G>(f_g, m_core, f_k); }
+
+private:
+	template<class G>
+	void bucket(const G& f_g)
+	{
+		unsigned n = f_g.V();
+		if(!n)
+			return;
+
+		std::vector<unsigned>& deg = m_core;
+		unsigned md = 0;
+		for(unsigned v = 0; v < n; v++)
+		{
+			deg[v] = f_g.degree(v);
+			if(deg[v] > md)
+				md = deg[v];
+		}
+
+		// Counting sort of the vertices by degree:
+		// bin[d] - the start of the bucket d in vert, pos[v] - the index of v in vert
+		std::vector<unsigned> bin(md + 1), vert(n), pos(n);
+		for(unsigned v = 0; v < n; v++)
+			bin[deg[v]]++;
+		for(unsigned d = 0, start = 0; d <= md; d++)
+		{
+			unsigned num = bin[d];
+			bin[d] = start;
+			start += num;
+		}
+		for(unsigned v = 0; v < n; v++)
+		{
+			pos[v] = bin[deg[v]]++;
+			vert[pos[v]] = v;
+		}
+		for(unsigned d = md; d > 0; d--)
+			bin[d] = bin[d - 1];
+		bin[0] = 0;
+
+		// Take the vertices in the order of their current degree and move
+		// every neighbour with a higher degree one bucket down
+		for(unsigned i = 0; i < n; i++)
+		{
+			unsigned v = vert[i];
+			for(typename G::AdjIterator it = f_g.begin(v), end = f_g.end(v); it != end; ++it)
+			{
+				unsigned u = *it;
+				if(deg[u] <= deg[v])
+					continue;
+				unsigned du = deg[u], pu = pos[u];
+				unsigned pw = bin[du], w = vert[pw];
+				if(u != w)
+				{
+					pos[u] = pw; vert[pu] = w;
+					pos[w] = pu; vert[pw] = u;
+				}
+				bin[du]++;
+				deg[u]--;
+			}
+		}
+	}
+
+	/**
+	 * Every thread keeps buckets of vertices by their current degree for
+	 * a window [base, top) of degrees and an overflow list of the vertices
+	 * above it. A vertex whose degree drops into the window goes to the
+	 * bucket of the new degree (the entry in the old bucket goes stale).
+	 * Level k starts from the bucket k of all the threads; every round the
+	 * threads share the frontier evenly, remove it and collect the
+	 * neighbours dropping to k as the next frontier. The next k is the
+	 * lowest non-empty bucket; once the window is used up, the overflow is
+	 * bucketed into the next one, twice as wide. The threads stay up for
+	 * the whole decomposition and meet at a barrier after every round.
+	 */
+	template<class G>
+	void peel(const G& f_g, unsigned f_threads)
+	{
+		unsigned n = f_g.V(), T = f_threads;
+		std::vector< std::atomic<unsigned> > deg(n);
+		std::vector<char> done(n);
+		for(unsigned v = 0; v < n; v++)
+			deg[v].store(f_g.degree(v), std::memory_order_relaxed);
+
+		// Double-buffered by the parity of the round (of the reduction):
+		// a buffer is rewritten only after a barrier past its last read
+		CBarrier barrier(T);
+		std::vector< std::vector<unsigned> > frontier[2];
+		std::vector<unsigned> slot[2];
+		for(unsigned p = 0; p < 2; p++)
+		{
+			frontier[p].resize(T);
+			slot[p].resize(T);
+		}
+
+		parallel_run(T, [&](unsigned t)
+		{
+			unsigned round = 0, reduction = 0;
+			auto min_of = [&](unsigned f_value)
+			{
+				std::vector<unsigned>& s = slot[reduction++ & 1];
+				s[t] = f_value;
+				barrier.wait();
+				return *std::min_element(s.begin(), s.end());
+			};
+
+			std::vector< std::vector<unsigned> > bucket;
+			std::vector<unsigned> over;
+			for(unsigned v = (unsigned)((unsigned long long)n * t / T),
+						 end = (unsigned)((unsigned long long)n * (t + 1) / T); v < end; v++)
+				over.push_back(v);
+
+			for(unsigned base = 0, top = 0, k = 0, at = 0;;)
+			{
+				// The lowest non-empty bucket of all the threads
+				while(at < bucket.size() && bucket[at].empty())
+					at++;
+				k = min_of((at < bucket.size()) ? base + at : NoCore);
+				if(k == NoCore)
+				{
+					// The window is used up: the next one from the lowest degree left
+					unsigned j = 0, low = NoCore;
+					for(unsigned i = 0, no = over.size(); i < no; i++)
+					{
+						unsigned v = over[i];
+						if(done[v])
+							continue;
+						over[j++] = v;
+						low = std::min(low, deg[v].load(std::memory_order_relaxed));
+					}
+					over.resize(j);
+					base = min_of(low);
+					if(base == NoCore)
+						break;
+					top = 2 * base + CoreWindow;
+					bucket.assign(top - base, std::vector<unsigned>());
+					at = 0;
+					j = 0;
+					for(unsigned i = 0, no = over.size(); i < no; i++)
+					{
+						unsigned v = over[i], d = deg[v].load(std::memory_order_relaxed);
+						if(d < top)
+							bucket[d - base].push_back(v);
+						else
+							over[j++] = v;
+					}
+					over.resize(j);
+					continue;
+				}
+
+				// Level k: the live vertices of the bucket k
+				std::vector<unsigned>& first = frontier[round & 1][t];
+				if(k - base == at)
+				{
+					for(unsigned i = 0, nb = bucket[at].size(); i < nb; i++)
+					{
+						if(!done[bucket[at][i]])
+							first.push_back(bucket[at][i]);
+					}
+					std::vector<unsigned>().swap(bucket[at]);
+				}
+				barrier.wait();
+
+				for(;; round++)
+				{
+					const std::vector< std::vector<unsigned> >& cur = frontier[round & 1];
+					std::vector<unsigned>& next = frontier[(round + 1) & 1][t];
+					next.clear();
+					unsigned total = 0;
+					for(unsigned p = 0; p < T; p++)
+						total += cur[p].size();
+					if(!total)
+						break;
+
+					// The share of this thread in the frontiers of all the threads
+					unsigned i = (unsigned)((unsigned long long)total * t / T);
+					unsigned end = (unsigned)((unsigned long long)total * (t + 1) / T);
+					for(unsigned p = 0, skip = 0; p < T && i < end; skip += cur[p].size(), p++)
+					{
+						for(; i < end && i - skip < cur[p].size(); i++)
+						{
+							unsigned v = cur[p][i - skip];
+							m_core[v] = k;
+							done[v] = 1;
+							for(typename G::AdjIterator it = f_g.begin(v), e = f_g.end(v); it != e; ++it)
+							{
+								std::atomic<unsigned>& du = deg[*it];
+								if(du.load(std::memory_order_relaxed) <= k)
+									continue;
+								unsigned d = du.fetch_sub(1, std::memory_order_relaxed);
+								if(d == k + 1)
+									next.push_back(*it);
+								else if(d <= k)
+									du.fetch_add(1, std::memory_order_relaxed);
+								else if(d - 1 < top)
+									bucket[d - 1 - base].push_back(*it);
+							}
+						}
+					}
+					barrier.wait();
+				}
+
+				// The buckets up to k are empty everywhere; the level may have
+				// filled the ones below the local minimum
+				at = k - base + 1;
+			}
+		});
+	}
+
+private:
+	std::vector<unsigned> m_core;
+	unsigned m_max;
+};
+
+#endif // __GRAPH_KCORE__
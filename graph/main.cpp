@@ -1,12 +1,198 @@
 #include <iostream>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 
 #include "graph.h"
 #include "cc.h"
 #include "loop.h"
 #include "euler.h"
+#include "ingest.h"
+#include "snapshot.h"
+#include "kcore.h"
+#include "msf.h"
+#include "partition.h"
 
 
-int main(int, char**)
+// Concurrent ingest throughput for 1, 2, 4, ... threads
+static void check_ingest(unsigned f_V, unsigned f_E)
+{
+	std::vector<edge_t> edges(f_E);
+	std::mt19937 rng(f_V);
+	for(unsigned i = 0; i < f_E; i++)
+		edges[i] = edge_t(rng() % f_V, rng() % f_V);
+
+	unsigned nMax = std::thread::hardware_concurrency();
+	if(!nMax)
+		nMax = 1;
+	std::cout << "Ingest of " << f_E << " edges over " << f_V << " vertices:" << std::endl;
+	for(unsigned n = 1;; n = (n * 2 > nMax && n < nMax) ? nMax : n * 2)
+	{
+		CGraphBuilder b(f_V);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+		for(unsigned t = 0; t < n; t++)
+		{
+			threads.push_back(std::thread([&b, &edges, t, n, f_E]()
+			{
+				for(unsigned i = (unsigned)((unsigned long long)f_E * t / n),
+							 end = (unsigned)((unsigned long long)f_E * (t + 1) / n); i < end; i++)
+					b.insert(edges[i].first, edges[i].second);
+			}));
+		}
+		for(unsigned t = 0; t < n; t++)
+			threads[t].join();
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		CSGraph g = b.freeze();
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+		double sec = std::chrono::duration<double>(t1 - t0).count();
+		std::cout << "  " << n << " thread" << (n == 1 ? "" : "s") << ": "
+				  << (f_E / sec / 1e6) << " Medges/s, freeze "
+				  << std::chrono::duration<double>(t2 - t1).count() << " sec"
+				  << (g.E() == f_E ? "" : " (FAILED!!!)") << std::endl;
+		if(n >= nMax)
+			break;
+	}
+}
+
+// Sequential and parallel k-core decompositions must agree
+static void check_core(unsigned f_V, unsigned f_E)
+{
+	CGraphBuilder b(f_V);
+	std::mt19937 rng(f_E);
+	for(unsigned i = 0; i < f_E; i++)
+		b.insert(rng() % f_V, rng() % f_V);
+	CSGraph g = b.freeze();
+
+	unsigned n = std::thread::hardware_concurrency();
+	if(n < 2)
+		n = 2;
+	// Untimed run: the first allocations of new threads sort out the
+	// chunks the ingest threads left in the allocator's arenas (~0.1 sec)
+	CGraphCore warm(g, n);
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	CGraphCore seq(g);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	CGraphCore par(g, n);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	bool bOK = true;
+	for(unsigned v = 0; v < f_V && bOK; v++)
+		bOK = (seq.core(v) == par.core(v));
+	std::cout << "k-core (degeneracy " << seq.degeneracy() << "): " << (bOK ? "OK" : "FAILED!!!")
+			  << " (bucket " << std::chrono::duration<double>(t1 - t0).count()
+			  << " sec, " << n << "-thread peeling " << std::chrono::duration<double>(t2 - t1).count()
+			  << " sec)" << std::endl;
+}
+// Kruskal vs parallel Boruvka on a random sparse graph
+static void check_msf(unsigned f_V, unsigned f_E)
+{
+	CMinSpanForest::edges_t edges(f_E);
+	std::mt19937 rng(f_E);
+	for(unsigned i = 0; i < f_E; i++)
+		edges[i] = WeightedEdge(rng() % f_V, rng() % f_V, (rng() % 1000000) / 1000.0);
+
+	unsigned n = std::thread::hardware_concurrency();
+	if(!n)
+		n = 1;
+	std::cout << "MSF of " << f_E << " edges over " << f_V << " vertices:" << std::endl;
+
+	double w[2];
+	const char* names[2] = { "Kruskal", "Boruvka" };
+	for(unsigned a = 0; a < 2; a++)
+	{
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		CMinSpanForest msf(f_V, edges, a ? CMinSpanForest::AlgBoruvka : CMinSpanForest::AlgKruskal, n);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		w[a] = msf.weight();
+		std::cout << "  " << names[a] << " (" << n << " thread" << (n == 1 ? "" : "s") << "): "
+				  << std::chrono::duration<double>(t1 - t0).count() << " sec, weight " << (unsigned long long)w[a]
+				  << ", " << msf.count() << " edges, " << msf.trees() << " trees" << std::endl;
+	}
+	std::cout << "  Weights " << ((w[0] - w[1] < 1e-3 && w[1] - w[0] < 1e-3) ? "match" : "DIFFER!!!") << std::endl;
+}
+
+// Multi-process BFS/CC must match the single-process ones. The workers
+// load the edge file before the reference graph is built here.
+static void check_partition(unsigned f_V, unsigned f_E, unsigned f_workers)
+{
+	// A unique name in the shared /tmp, created by us
+	char path[] = "/tmp/partition.edges.XXXXXX";
+	int fd = mkstemp(path);
+	FILE* f = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+	if(!f)
+	{
+		std::cout << "Partitioned BFS: can't create the edge file in /tmp" << std::endl;
+		if(fd >= 0)
+		{
+			close(fd);
+			remove(path);
+		}
+		return;
+	}
+	std::mt19937 rng(f_V);
+	for(unsigned i = 0; i < f_E; i++)
+	{
+		unsigned e[2] = { (unsigned)(rng() % f_V), (unsigned)(rng() % f_V) };
+		fwrite(e, sizeof(e), 1, f);
+	}
+	fclose(f);
+
+	CGraphCluster cluster(path, f_V, f_workers);
+	remove(path);
+
+	CGraphBuilder b(f_V);
+	rng.seed(f_V);
+	for(unsigned i = 0; i < f_E; i++)
+	{
+		unsigned v = rng() % f_V;
+		b.insert(v, rng() % f_V);
+	}
+	CSGraph g = b.freeze();
+
+	// BFS: the same vertices at the same levels
+	CGraphBFS<CSGraph> bfs(g);
+	bfs.traverse(0);
+	CPartitionedBFS pbfs(cluster, 0);
+	bool bOK = true;
+	for(unsigned v = 0; v < f_V && bOK; v++)
+	{
+		bOK = (bfs.visited(v) == pbfs.visited(v));
+		if(bOK && v && pbfs.visited(v))
+			bOK = (pbfs.level(pbfs.parent(v)) + 1 == pbfs.level(v));
+	}
+	for(unsigned v = 0; v < f_V && bOK; v++)
+	{
+		// Sequential BFS levels along its own tree
+		unsigned l = 0;
+		if(bfs.visited(v))
+			for(unsigned w = v; w; w = bfs.parent(w))
+				l++;
+		bOK = (!bfs.visited(v) || l == pbfs.level(v));
+	}
+	bOK = bOK && (cluster.E() == g.E());
+	std::cout << "Partitioned BFS (" << f_workers << " workers): " << (bOK ? "OK" : "FAILED!!!") << std::endl;
+
+	// Components
+	CConnectedComponent cc(g);
+	CPartitionedCC pcc(cluster);
+	bOK = (cc.count() == pcc.count());
+	for(unsigned i = 0; i < cc.count() && bOK; i++)
+	{
+		CConnectedComponent::component_t c = cc.component(i);
+		std::sort(c.begin(), c.end());
+		bOK = (c == pcc.component(i));
+	}
+	std::cout << "Partitioned CC (" << pcc.count() << " components): " << (bOK ? "OK" : "FAILED!!!") << std::endl;
+}
+
+// The optional argument is the edge count for the spanning forest benchmark
+int main(int argc, char** argv)
 {
 	unsigned v[][2] =
 	{
@@ -56,6 +242,25 @@ int main(int, char**)
 		break;
 	}
 
+#ifdef GRAPH_TRAVERSE_STATS
+	for(CGraphBFS<CEGraph> bfs(g);;)
+	{
+		bfs.traverse(0);
+		std::cout << "BFS stats: ";
+		bfs.stats().dump(std::cout);
+		std::cout << std::endl;
+		break;
+	}
+	for(CGraphDFS<CEGraph> dfs(g);;)
+	{
+		dfs.traverse(0);
+		std::cout << "DFS stats: ";
+		dfs.stats().dump(std::cout);
+		std::cout << std::endl;
+		break;
+	}
+#endif
+
 	// Loops
 	for(CGraphLoop L(g);;)
 	{
@@ -102,6 +307,54 @@ int main(int, char**)
 		break;
 	}
 
+	// Concurrent ingest: the frozen graph must match the sequential one
+	for(;;)
+	{
+		CGraphBuilder b(g.V());
+		for(unsigned i = 0; i < sizeof(v) / sizeof(*v); i++)
+			b.insert(v[i][0], v[i][1]);
+		CSGraph sg = b.freeze();
+		CConnectedComponent cc(sg);
+		std::cout << "Frozen graph: " << sg.V() << " vertices, " << sg.E() << " edges, "
+				  << cc.count() << " component" << (cc.count() == 1 ? "" : "s") << std::endl;
+
+		// Euler over a copy-on-write snapshot leaves the frozen graph intact
+		CGraphEuler euler(sg, 0);
+		std::cout << "Frozen graph Euler path(" << euler.length() << "):";
+		for(unsigned i = 0, n = euler.length(); i < n; i++)
+			std::cout << ' ' << euler[i];
+		std::cout << ", " << sg.E() << " edges left" << std::endl;
+
+		check_ingest(1 << 18, 1 << 22);
+		break;
+	}
+
+	// k-cores
+	for(CGraphCore core(g);;)
+	{
+		std::cout << "Core numbers:";
+		for(unsigned i = 0; i < g.V(); i++)
+			std::cout << ' ' << core.core(i);
+		std::cout << std::endl;
+
+		unsigned k = core.degeneracy();
+		CSGraph sub(core.subgraph(g, k));
+		std::cout << k << "-core: " << sub.E() << " edges" << std::endl << sub;
+
+		check_core(1 << 16, 1 << 20);
+		break;
+	}
+
+	// Spanning forest
+	for(;;)
+	{
+		unsigned E = (argc > 1) ? strtoul(argv[1], NULL, 10) : (1 << 20);
+		check_msf(E / 4 + 1, E);
+		break;
+	}
+
+	check_partition(1 << 16, 1 << 16, 4);
+
 	return 0;
 }
 
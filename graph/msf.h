@@ -0,0 +1,169 @@
+#ifndef __GRAPH_MSF__
+#define __GRAPH_MSF__
+
+#include <atomic>
+
+#include "uf.h"
+#include "parallel.h"
+
+
+struct WeightedEdge
+{
+	WeightedEdge(): V(0), W(0), Weight(0) {}
+	WeightedEdge(unsigned f_v, unsigned f_w, double f_weight): V(f_v), W(f_w), Weight(f_weight) {}
+
+	unsigned V;
+	unsigned W;
+	double Weight;
+};
+
+// ============================================================================
+// Minimum Spanning Forest of an undirected weighted graph (edge list)
+//
+// Kruskal: sort the edges by weight (in parallel), then scan them joining
+//          the components with a union-find.
+// Boruvka: every round each component picks its lightest outgoing edge in
+//          parallel; the picked edges merge the components and the edges
+//          inside a component are dropped, so the edge list contracts.
+class CMinSpanForest
+{
+public:
+	enum Algorithm { AlgKruskal, AlgBoruvka };
+
+	typedef std::vector<WeightedEdge> edges_t;
+
+public:
+	CMinSpanForest(unsigned f_V, const edges_t& f_edges, Algorithm f_alg = AlgKruskal, unsigned f_threads = 1):
+		m_V(f_V),
+		m_weight(0)
+	{
+		if(f_alg == AlgBoruvka)
+			boruvka(f_edges, f_threads ? f_threads : 1);
+		else
+			kruskal(f_edges, f_threads ? f_threads : 1);
+
+		for(unsigned i = 0, n = m_forest.size(); i < n; i++)
+			m_weight += m_forest[i].Weight;
+	}
+
+	double weight() const { return m_weight; }
+	unsigned trees() const { return m_V - m_forest.size(); }
+
+	unsigned count() const { return m_forest.size(); }
+	const WeightedEdge& edge(unsigned f_i) const { return m_forest.at(f_i); }
+
+private:
+	static bool lighter(const WeightedEdge& f_a, const WeightedEdge& f_b) { return (f_a.Weight < f_b.Weight); }
+
+	void kruskal(const edges_t& f_edges, unsigned f_threads)
+	{
+		edges_t e(f_edges);
+		if(e.empty())
+			return;
+		parallel_sort(&e[0], e.size(), f_threads, lighter);
+
+		CUnionFind uf(m_V);
+		for(unsigned i = 0, n = e.size(); i < n && m_forest.size() + 1 < m_V; i++)
+		{
+			if(e[i].V < m_V && e[i].W < m_V && uf.unite(e[i].V, e[i].W))
+				m_forest.push_back(e[i]);
+		}
+	}
+
+	void boruvka(const edges_t& f_edges, unsigned f_threads)
+	{
+		static const unsigned NoEdge = ~0u;
+
+		// Indices of the edges still connecting different components
+		std::vector<unsigned> live;
+		live.reserve(f_edges.size());
+		for(unsigned i = 0, n = f_edges.size(); i < n; i++)
+		{
+			const WeightedEdge& e = f_edges[i];
+			if(e.V < m_V && e.W < m_V && e.V != e.W)
+				live.push_back(i);
+		}
+
+		CUnionFind uf(m_V);
+		std::vector<unsigned> label(m_V);
+		for(unsigned v = 0; v < m_V; v++)
+			label[v] = v;
+		std::vector< std::atomic<unsigned> > best(m_V);
+		std::vector< std::vector<unsigned> > keep(f_threads);
+
+		// Ties are broken by the edge index so that no cycle can be picked
+		struct Less
+		{
+			const edges_t& E;
+			Less(const edges_t& f_e): E(f_e) {}
+			bool operator()(unsigned f_a, unsigned f_b) const
+			{
+				if(f_b == NoEdge)
+					return true;
+				return (E[f_a].Weight < E[f_b].Weight ||
+						(E[f_a].Weight == E[f_b].Weight && f_a < f_b));
+			}
+		} less(f_edges);
+
+		while(!live.empty())
+		{
+			parallel_for(m_V, f_threads, [&](unsigned, unsigned f_begin, unsigned f_end)
+			{
+				for(unsigned v = f_begin; v < f_end; v++)
+					best[v].store(NoEdge, std::memory_order_relaxed);
+			});
+
+			// The lightest edge out of every component
+			parallel_for(live.size(), f_threads, [&](unsigned, unsigned f_begin, unsigned f_end)
+			{
+				for(unsigned i = f_begin; i < f_end; i++)
+				{
+					const WeightedEdge& e = f_edges[live[i]];
+					unsigned c[2] = { label[e.V], label[e.W] };
+					for(unsigned j = 0; j < 2; j++)
+					{
+						unsigned cur = best[c[j]].load(std::memory_order_relaxed);
+						while(less(live[i], cur) &&
+							  !best[c[j]].compare_exchange_weak(cur, live[i], std::memory_order_relaxed)) {}
+					}
+				}
+			});
+
+			// Merge (the unions are cheap next to the edge scans)
+			for(unsigned v = 0; v < m_V; v++)
+			{
+				unsigned i = best[v].load(std::memory_order_relaxed);
+				if(label[v] == v && i != NoEdge && uf.unite(f_edges[i].V, f_edges[i].W))
+					m_forest.push_back(f_edges[i]);
+			}
+
+			// Contract
+			parallel_for(m_V, f_threads, [&](unsigned, unsigned f_begin, unsigned f_end)
+			{
+				for(unsigned v = f_begin; v < f_end; v++)
+					label[v] = uf.root(v);
+			});
+			for(unsigned t = 0; t < f_threads; t++)
+				keep[t].clear();
+			parallel_for(live.size(), f_threads, [&](unsigned t, unsigned f_begin, unsigned f_end)
+			{
+				for(unsigned i = f_begin; i < f_end; i++)
+				{
+					const WeightedEdge& e = f_edges[live[i]];
+					if(label[e.V] != label[e.W])
+						keep[t].push_back(live[i]);
+				}
+			});
+			live.clear();
+			for(unsigned t = 0; t < f_threads; t++)
+				live.insert(live.end(), keep[t].begin(), keep[t].end());
+		}
+	}
+
+private:
+	unsigned m_V;
+	edges_t m_forest;
+	double m_weight;
+};
+
+#endif // __GRAPH_MSF__
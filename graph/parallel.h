@@ -0,0 +1,115 @@
+#ifndef __GRAPH_PARALLEL__
+#define __GRAPH_PARALLEL__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+
+// Split [0, f_n) into f_threads contiguous slices and run
+// f_fn(thread, begin, end) for each of them in its own thread
+template<class F>
+void parallel_for(unsigned f_n, unsigned f_threads, F f_fn)
+{
+	if(f_threads < 2 || f_n < 2)
+	{
+		f_fn(0, 0, f_n);
+		return;
+	}
+	if(f_threads > f_n)
+		f_threads = f_n;
+
+	std::vector<std::thread> threads;
+	for(unsigned t = 1; t < f_threads; t++)
+	{
+		unsigned begin = (unsigned)((unsigned long long)f_n * t / f_threads);
+		unsigned end = (unsigned)((unsigned long long)f_n * (t + 1) / f_threads);
+		threads.push_back(std::thread(f_fn, t, begin, end));
+	}
+	f_fn(0, 0, (unsigned)((unsigned long long)f_n / f_threads));
+	for(unsigned t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
+
+// Run f_fn(thread) once in each of f_threads threads, the calling one
+// included: for workers that stay up across rounds and sync on a CBarrier
+template<class F>
+void parallel_run(unsigned f_threads, F f_fn)
+{
+	std::vector<std::thread> threads;
+	for(unsigned t = 1; t < f_threads; t++)
+		threads.push_back(std::thread(f_fn, t));
+	f_fn(0);
+	for(unsigned t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
+
+// Reusable barrier: wait() returns once all the f_n threads have called it
+class CBarrier
+{
+public:
+	CBarrier(unsigned f_n): m_n(f_n), m_waiting(0), m_generation(0) {}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		unsigned generation = m_generation;
+		if(++m_waiting == m_n)
+		{
+			m_waiting = 0;
+			m_generation++;
+			m_cv.notify_all();
+			return;
+		}
+		m_cv.wait(lock, [&]() { return (generation != m_generation); });
+	}
+
+private:
+	CBarrier(const CBarrier&);
+	CBarrier& operator=(const CBarrier&);
+
+private:
+	const unsigned m_n;
+	unsigned m_waiting;
+	unsigned m_generation;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+};
+
+// Sort every slice in its own thread, then merge the neighbouring slices pairwise
+template<class T, class Cmp>
+void parallel_sort(T* f_a, unsigned f_n, unsigned f_threads, Cmp f_cmp)
+{
+	if(f_threads < 2 || f_n < 2 * f_threads)
+	{
+		std::sort(f_a, f_a + f_n, f_cmp);
+		return;
+	}
+
+	std::vector<unsigned> bounds(f_threads + 1);
+	for(unsigned t = 0; t <= f_threads; t++)
+		bounds[t] = (unsigned)((unsigned long long)f_n * t / f_threads);
+
+	parallel_for(f_threads, f_threads, [&](unsigned, unsigned f_begin, unsigned f_end)
+	{
+		for(unsigned i = f_begin; i < f_end; i++)
+			std::sort(f_a + bounds[i], f_a + bounds[i + 1], f_cmp);
+	});
+	for(unsigned width = 1; width < f_threads; width *= 2)
+	{
+		unsigned pairs = (f_threads + 2 * width - 1) / (2 * width);
+		parallel_for(pairs, pairs, [&](unsigned, unsigned f_begin, unsigned f_end)
+		{
+			for(unsigned i = f_begin; i < f_end; i++)
+			{
+				unsigned l = i * 2 * width, m = l + width, r = std::min(m + width, f_threads);
+				if(m < f_threads)
+					std::inplace_merge(f_a + bounds[l], f_a + bounds[m], f_a + bounds[r], f_cmp);
+			}
+		});
+	}
+}
+
+#endif // __GRAPH_PARALLEL__
@@ -0,0 +1,622 @@
+#ifndef __GRAPH_PARTITION__
+#define __GRAPH_PARTITION__
+
+#include <vector>
+#include <algorithm>
+
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "graph.h"
+#include "uf.h"
+
+
+// ============================================================================
+// Vertex ranges: worker p owns [lo(p), hi(p))
+struct CPartition
+{
+	CPartition(unsigned f_V, unsigned f_P): V(f_V), P(f_P), Block((f_V + f_P - 1) / f_P) {}
+
+	unsigned lo(unsigned f_p) const { return std::min(f_p * Block, V); }
+	unsigned hi(unsigned f_p) const { return std::min(lo(f_p) + Block, V); }
+	unsigned owner(unsigned f_v) const { return f_v / Block; }
+
+	unsigned V;
+	unsigned P;
+	unsigned Block;
+};
+
+static const unsigned NoVertex = ~0u;
+
+// Blocking I/O on the coordinator channels
+static void io_write(int f_fd, const void* f_buf, size_t f_n)
+{
+	for(const char* p = (const char*)f_buf; f_n;)
+	{
+		ssize_t r = write(f_fd, p, f_n);
+		if(r < 0 && errno == EINTR)
+			continue;
+		ASSERT(r > 0);
+		p += r;
+		f_n -= r;
+	}
+}
+
+static void io_read(int f_fd, void* f_buf, size_t f_n)
+{
+	for(char* p = (char*)f_buf; f_n;)
+	{
+		ssize_t r = read(f_fd, p, f_n);
+		if(r < 0 && errno == EINTR)
+			continue;
+		ASSERT(r > 0);
+		p += r;
+		f_n -= r;
+	}
+}
+
+// Call f_f(v, w) for every edge of a file of {v, w} pairs of 32-bit
+// vertex numbers, read a block at a time
+enum { EdgeBlock = 1 << 16 };
+
+template<class F>
+static void for_each_edge(int f_fd, F f_f)
+{
+	std::vector<unsigned> buf(2 * EdgeBlock);
+	for(off_t off = 0;;)
+	{
+		ssize_t r = pread(f_fd, &buf[0], buf.size() * sizeof(unsigned), off);
+		if(r < 0 && errno == EINTR)
+			continue;
+		ASSERT(r >= 0);
+		size_t n = r / (2 * sizeof(unsigned));
+		if(!n)
+			return;
+		for(size_t i = 0; i < n; i++)
+			f_f(buf[2 * i], buf[2 * i + 1]);
+		off += n * 2 * sizeof(unsigned);
+	}
+}
+
+// ============================================================================
+// Worker process: reads the edge file itself and keeps the adjacency of
+// its own vertex range only, then runs level-synchronous algorithms,
+// exchanging batches with its peers over Unix domain sockets after every
+// level.
+class CPartitionWorker
+{
+public:
+	enum Command { CmdQuit, CmdBFS, CmdCC };
+
+public:
+	CPartitionWorker(const char* f_edges, unsigned f_V, unsigned f_rank, unsigned f_P, const std::vector<int>& f_peers, int f_coord):
+		m_part(f_V, f_P),
+		m_rank(f_rank),
+		m_lo(m_part.lo(f_rank)),
+		m_hi(m_part.hi(f_rank)),
+		m_offset(m_hi - m_lo + 1),
+		m_peers(f_peers),
+		m_coord(f_coord),
+		m_out(f_P),
+		m_in(f_P)
+	{
+		// The edges of the own range (by their first vertex) tell the
+		// coordinator that the shard is loaded
+		unsigned edges = load(f_edges);
+		io_write(m_coord, &edges, sizeof(edges));
+	}
+
+	void run()
+	{
+		for(;;)
+		{
+			unsigned cmd[2];
+			io_read(m_coord, cmd, sizeof(cmd));
+			switch(cmd[0])
+			{
+				case CmdBFS:	bfs(cmd[1]); break;
+				case CmdCC:		cc(); break;
+				default:		return;
+			}
+		}
+	}
+
+private:
+	bool owns(unsigned f_v) const { return (f_v >= m_lo && f_v < m_hi); }
+
+	// Two passes over the edges: the degrees of the own vertices, then their
+	// neighbours (in the order of the file, as CGraphBuilder::freeze() lists
+	// them); the edges of the other ranges are skipped
+	unsigned load(const char* f_edges)
+	{
+		int fd = open(f_edges, O_RDONLY);
+		ASSERT(fd >= 0);
+
+		unsigned n = m_hi - m_lo, V = m_part.V, edges = 0;
+		for_each_edge(fd, [this, V, &edges](unsigned v, unsigned w)
+		{
+			if(v >= V || w >= V)
+				return;
+			if(owns(v))
+			{
+				m_offset[v - m_lo + 1]++;
+				edges++;
+			}
+			if(owns(w))
+				m_offset[w - m_lo + 1]++;
+		});
+		for(unsigned v = 0; v < n; v++)
+			m_offset[v + 1] += m_offset[v];
+
+		m_adj.resize(m_offset[n]);
+		std::vector<unsigned> pos(m_offset.begin(), m_offset.end() - 1);
+		for_each_edge(fd, [this, V, &pos](unsigned v, unsigned w)
+		{
+			if(v >= V || w >= V)
+				return;
+			if(owns(v))
+				m_adj[pos[v - m_lo]++] = w;
+			if(owns(w))
+				m_adj[pos[w - m_lo]++] = v;
+		});
+		close(fd);
+		return edges;
+	}
+
+	void bfs(unsigned f_src)
+	{
+		unsigned n = m_hi - m_lo;
+		std::vector<unsigned> parent(n, NoVertex), level(n, NoVertex);
+		std::vector<unsigned> frontier, next;
+
+		if(owns(f_src))
+		{
+			parent[f_src - m_lo] = f_src;
+			level[f_src - m_lo] = 0;
+			frontier.push_back(f_src);
+		}
+
+		for(unsigned depth = 1;; depth++)
+		{
+			reset();
+			next.clear();
+			for(unsigned i = 0, nf = frontier.size(); i < nf; i++)
+			{
+				unsigned v = frontier[i];
+				for(unsigned j = m_offset[v - m_lo], end = m_offset[v - m_lo + 1]; j < end; j++)
+				{
+					unsigned w = m_adj[j];
+					if(owns(w))
+					{
+						if(parent[w - m_lo] == NoVertex)
+						{
+							parent[w - m_lo] = v;
+							level[w - m_lo] = depth;
+							next.push_back(w);
+						}
+						continue;
+					}
+					std::vector<unsigned>& out = m_out[m_part.owner(w)];
+					out.push_back(v);
+					out.push_back(w);
+				}
+			}
+
+			// Nobody had a frontier: the traversal is over
+			bool active = exchange(frontier.size());
+			for(unsigned p = 0; p < m_part.P; p++)
+			{
+				const std::vector<unsigned>& in = m_in[p];
+				for(unsigned i = 2, ni = in.size(); i + 1 < ni; i += 2)
+				{
+					unsigned w = in[i + 1];
+					if(parent[w - m_lo] == NoVertex)
+					{
+						parent[w - m_lo] = in[i];
+						level[w - m_lo] = depth;
+						next.push_back(w);
+					}
+				}
+			}
+			if(!active)
+				break;
+			frontier.swap(next);
+		}
+
+		if(n)
+		{
+			io_write(m_coord, &parent[0], n * sizeof(unsigned));
+			io_write(m_coord, &level[0], n * sizeof(unsigned));
+		}
+	}
+
+	// Min-label propagation: the local components are found with a
+	// union-find once, then every round the components whose label went
+	// down send it over their boundary edges to the owners of the far ends
+	void cc()
+	{
+		unsigned n = m_hi - m_lo;
+		CUnionFind uf(n);
+		std::vector<unsigned> boundary;
+		for(unsigned v = 0; v < n; v++)
+		{
+			bool remote = false;
+			for(unsigned j = m_offset[v], end = m_offset[v + 1]; j < end; j++)
+			{
+				unsigned w = m_adj[j];
+				if(owns(w))
+					uf.unite(v, w - m_lo);
+				else
+					remote = true;
+			}
+			if(remote)
+				boundary.push_back(v);
+		}
+
+		// Labels live in the roots; the lowest vertex is met first
+		std::vector<unsigned> label(n, NoVertex);
+		std::vector<bool> changed(n);
+		for(unsigned v = 0; v < n; v++)
+		{
+			unsigned r = uf.find(v);
+			if(label[r] == NoVertex)
+			{
+				label[r] = m_lo + v;
+				changed[r] = true;
+			}
+		}
+
+		for(;;)
+		{
+			reset();
+			unsigned sent = 0;
+			for(unsigned i = 0, nb = boundary.size(); i < nb; i++)
+			{
+				unsigned v = boundary[i], r = uf.find(v);
+				if(!changed[r])
+					continue;
+				for(unsigned j = m_offset[v], end = m_offset[v + 1]; j < end; j++)
+				{
+					unsigned w = m_adj[j];
+					if(owns(w))
+						continue;
+					std::vector<unsigned>& out = m_out[m_part.owner(w)];
+					out.push_back(w);
+					out.push_back(label[r]);
+					sent++;
+				}
+			}
+			for(unsigned i = 0, nb = boundary.size(); i < nb; i++)
+				changed[uf.find(boundary[i])] = false;
+
+			bool active = exchange(sent);
+			for(unsigned p = 0; p < m_part.P; p++)
+			{
+				const std::vector<unsigned>& in = m_in[p];
+				for(unsigned i = 2, ni = in.size(); i + 1 < ni; i += 2)
+				{
+					unsigned r = uf.find(in[i] - m_lo);
+					if(in[i + 1] < label[r])
+					{
+						label[r] = in[i + 1];
+						changed[r] = true;
+					}
+				}
+			}
+			if(!active)
+				break;
+		}
+
+		for(unsigned v = 0; v < n; v++)
+			label[v] = label[uf.find(v)];
+		if(n)
+			io_write(m_coord, &label[0], n * sizeof(unsigned));
+	}
+
+	// ================================
+	// Batches: {words following, active count, payload...}
+	void reset()
+	{
+		for(unsigned p = 0; p < m_part.P; p++)
+			m_out[p].assign(2, 0);
+	}
+
+	/**
+	 * Send m_out[p] to every peer and receive m_in[p] from each of them.
+	 * All the sockets are polled at once so that two workers never block
+	 * writing to each other. Return false if the active counts of all
+	 * the workers are zero.
+	 */
+	bool exchange(unsigned f_active)
+	{
+		unsigned P = m_part.P;
+		std::vector<size_t> sent(P), got(P);
+		for(unsigned p = 0; p < P; p++)
+		{
+			m_out[p][0] = m_out[p].size() - 1;
+			m_out[p][1] = f_active;
+			m_in[p].assign(1, 0);
+		}
+
+		std::vector<pollfd> fds;
+		std::vector<unsigned> who;
+		for(;;)
+		{
+			fds.clear();
+			who.clear();
+			for(unsigned p = 0; p < P; p++)
+			{
+				if(p == m_rank)
+					continue;
+				pollfd fd = { m_peers[p], 0, 0 };
+				if(sent[p] < m_out[p].size() * sizeof(unsigned))
+					fd.events |= POLLOUT;
+				if(got[p] < m_in[p].size() * sizeof(unsigned))
+					fd.events |= POLLIN;
+				if(fd.events)
+				{
+					fds.push_back(fd);
+					who.push_back(p);
+				}
+			}
+			if(fds.empty())
+				break;
+
+			if(poll(&fds[0], fds.size(), -1) < 0)
+			{
+				ASSERT(errno == EINTR);
+				continue;
+			}
+			for(unsigned i = 0, nfd = fds.size(); i < nfd; i++)
+			{
+				unsigned p = who[i];
+				if(fds[i].revents & POLLOUT)
+				{
+					size_t total = m_out[p].size() * sizeof(unsigned);
+					ssize_t r = send(fds[i].fd, (const char*)&m_out[p][0] + sent[p], total - sent[p], MSG_NOSIGNAL);
+					ASSERT(r > 0 || errno == EAGAIN || errno == EINTR);
+					if(r > 0)
+						sent[p] += r;
+				}
+				if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				{
+					size_t total = m_in[p].size() * sizeof(unsigned);
+					ssize_t r = recv(fds[i].fd, (char*)&m_in[p][0] + got[p], total - got[p], 0);
+					ASSERT(r > 0 || (r < 0 && (errno == EAGAIN || errno == EINTR)));
+					if(r > 0)
+						got[p] += r;
+					// The header is in: make room for the rest
+					if(got[p] == sizeof(unsigned) && m_in[p].size() == 1)
+						m_in[p].resize(1 + m_in[p][0]);
+				}
+			}
+		}
+
+		unsigned long long active = f_active;
+		for(unsigned p = 0; p < P; p++)
+		{
+			if(p != m_rank)
+				active += m_in[p][1];
+		}
+		return active;
+	}
+
+private:
+	const CPartition m_part;
+	const unsigned m_rank;
+	const unsigned m_lo;
+	const unsigned m_hi;
+
+	// CSR of the own vertices, global vertex numbers
+	std::vector<unsigned> m_offset;
+	std::vector<unsigned> m_adj;
+
+	std::vector<int> m_peers;
+	int m_coord;
+
+	std::vector< std::vector<unsigned> > m_out;
+	std::vector< std::vector<unsigned> > m_in;
+};
+
+// ============================================================================
+// Local launcher and coordinator: forks the workers, connects them
+// all-to-all with socket pairs and collects the results. The graph is
+// never loaded here: every worker reads the edge file ({v, w} pairs of
+// 32-bit vertex numbers, out-of-range ones are skipped) and keeps its own
+// range. The constructor returns once all the shards are loaded; the file
+// is not needed after that.
+class CGraphCluster
+{
+public:
+	CGraphCluster(const char* f_edges, unsigned f_V, unsigned f_workers):
+		m_part(f_V, f_workers ? f_workers : 1)
+	{
+		unsigned P = m_part.P;
+
+		// mesh[p][q] - the end of the p<->q channel owned by p
+		std::vector< std::vector<int> > mesh(P, std::vector<int>(P, -1));
+		for(unsigned p = 0; p < P; p++)
+		{
+			for(unsigned q = p + 1; q < P; q++)
+			{
+				int sv[2];
+				ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+				mesh[p][q] = sv[0];
+				mesh[q][p] = sv[1];
+			}
+		}
+
+		for(unsigned p = 0; p < P; p++)
+		{
+			int sv[2];
+			ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+			pid_t pid = fork();
+			ASSERT(pid >= 0);
+			if(!pid)
+			{
+				// Keep the own channels only
+				close(sv[0]);
+				for(unsigned i = 0; i < m_coord.size(); i++)
+					close(m_coord[i]);
+				for(unsigned i = 0; i < P; i++)
+				{
+					for(unsigned j = 0; j < P; j++)
+					{
+						if(i != p && mesh[i][j] >= 0)
+							close(mesh[i][j]);
+					}
+				}
+				for(unsigned q = 0; q < P; q++)
+				{
+					if(q != p)
+						fcntl(mesh[p][q], F_SETFL, fcntl(mesh[p][q], F_GETFL) | O_NONBLOCK);
+				}
+
+				CPartitionWorker worker(f_edges, f_V, p, P, mesh[p], sv[1]);
+				worker.run();
+				_exit(0);
+			}
+
+			close(sv[1]);
+			m_coord.push_back(sv[0]);
+			m_pids.push_back(pid);
+		}
+
+		for(unsigned p = 0; p < P; p++)
+		{
+			for(unsigned q = 0; q < P; q++)
+			{
+				if(mesh[p][q] >= 0)
+					close(mesh[p][q]);
+			}
+		}
+
+		m_E = 0;
+		for(unsigned p = 0; p < P; p++)
+		{
+			unsigned edges;
+			io_read(m_coord[p], &edges, sizeof(edges));
+			m_E += edges;
+		}
+	}
+	~CGraphCluster()
+	{
+		command(CPartitionWorker::CmdQuit, 0);
+		for(unsigned p = 0; p < m_pids.size(); p++)
+		{
+			close(m_coord[p]);
+			waitpid(m_pids[p], NULL, 0);
+		}
+	}
+
+	unsigned V() const { return m_part.V; }
+	unsigned E() const { return m_E; }
+	unsigned workers() const { return m_part.P; }
+
+	void bfs(unsigned f_v, std::vector<unsigned>& f_parent, std::vector<unsigned>& f_level)
+	{
+		f_parent.assign(V(), NoVertex);
+		f_level.assign(V(), NoVertex);
+		if(f_v >= V())
+			return;
+		command(CPartitionWorker::CmdBFS, f_v);
+		for(unsigned p = 0; p < m_part.P; p++)
+		{
+			unsigned lo = m_part.lo(p), n = m_part.hi(p) - lo;
+			if(!n)
+				continue;
+			io_read(m_coord[p], &f_parent[lo], n * sizeof(unsigned));
+			io_read(m_coord[p], &f_level[lo], n * sizeof(unsigned));
+		}
+	}
+
+	// f_label[v] is the lowest vertex of its component
+	void components(std::vector<unsigned>& f_label)
+	{
+		f_label.resize(V());
+		if(!V())
+			return;
+		command(CPartitionWorker::CmdCC, 0);
+		for(unsigned p = 0; p < m_part.P; p++)
+		{
+			unsigned lo = m_part.lo(p), n = m_part.hi(p) - lo;
+			if(n)
+				io_read(m_coord[p], &f_label[lo], n * sizeof(unsigned));
+		}
+	}
+
+private:
+	CGraphCluster(const CGraphCluster&);
+	CGraphCluster& operator=(const CGraphCluster&);
+
+	void command(unsigned f_cmd, unsigned f_arg)
+	{
+		unsigned cmd[2] = { f_cmd, f_arg };
+		for(unsigned p = 0; p < m_coord.size(); p++)
+			io_write(m_coord[p], cmd, sizeof(cmd));
+	}
+
+private:
+	const CPartition m_part;
+	unsigned m_E;
+	std::vector<int> m_coord;
+	std::vector<pid_t> m_pids;
+};
+
+// ============================================================================
+// Same result semantics as CGraphBFS (single source): the parent of the
+// source is the source itself; the tree may differ among equal-level parents.
+class CPartitionedBFS
+{
+public:
+	CPartitionedBFS(CGraphCluster& f_cluster, unsigned f_v) { f_cluster.bfs(f_v, m_parent, m_level); }
+
+	unsigned parent(unsigned f_v) const { return m_parent.at(f_v); }
+	bool visited(unsigned f_v) const { return (m_parent.at(f_v) != NoVertex); }
+	unsigned level(unsigned f_v) const { return m_level.at(f_v); }
+
+private:
+	std::vector<unsigned> m_parent;
+	std::vector<unsigned> m_level;
+};
+
+// Same components in the same order as CConnectedComponent;
+// the vertices of a component are listed in ascending order.
+class CPartitionedCC
+{
+public:
+	typedef std::vector<unsigned> component_t;
+
+public:
+	CPartitionedCC(CGraphCluster& f_cluster)
+	{
+		std::vector<unsigned> label;
+		f_cluster.components(label);
+
+		// Labels are the lowest vertices: the first vertex of a component opens it
+		std::vector<unsigned> index(label.size(), NoVertex);
+		for(unsigned v = 0, n = label.size(); v < n; v++)
+		{
+			unsigned l = label[v];
+			if(index[l] == NoVertex)
+			{
+				index[l] = m_components.size();
+				m_components.push_back( component_t() );
+			}
+			m_components[index[l]].push_back(v);
+		}
+	}
+
+	unsigned count() const { return m_components.size(); }
+	const component_t& component(unsigned f_i) { return m_components[f_i]; }
+
+private:
+	std::vector<component_t> m_components;
+};
+
+#endif // __GRAPH_PARTITION__
@@ -0,0 +1,165 @@
+#ifndef __GRAPH_SNAPSHOT__
+#define __GRAPH_SNAPSHOT__
+
+#include "graph.h"
+
+
+// ============================================================================
+// Copy-on-write view of a CSGraph
+//
+// Removed edges are recorded in a tombstone bitmap over the adjacency slots
+// of the base graph, which is never modified: a snapshot costs O(V) words
+// plus one bit per adjacency entry instead of a deep copy, and any number
+// of snapshots and readers may share the same base.
+class CSGraphSnapshot : public CGraph
+{
+	// Iterator
+public:
+	class AdjIterator
+	{
+		friend class CSGraphSnapshot;
+	public:
+		AdjIterator& operator++()
+		{
+			if(m_slot < m_end)
+				m_slot = m_g->next(m_slot + 1, m_end);
+			return *this;
+		}
+		unsigned operator*() const { return m_g->m_base.m_adj[m_slot]; }
+		bool operator!=(const AdjIterator& f_it) const { return (m_slot != f_it.m_slot); }
+		bool operator==(const AdjIterator& f_it) const { return (m_slot == f_it.m_slot); }
+	private:
+		AdjIterator(const CSGraphSnapshot* f_g, unsigned f_v, unsigned f_slot, unsigned f_end):
+			m_g(f_g), m_v(f_v), m_slot(f_slot), m_end(f_end)
+		{}
+	private:
+		const CSGraphSnapshot* m_g;
+		unsigned m_v;
+		unsigned m_slot;
+		unsigned m_end;
+	};
+
+	AdjIterator begin(unsigned f_v) const
+	{
+		if(f_v >= V())
+			return AdjIterator(this, f_v, 0, 0);
+		return AdjIterator(this, f_v, m_first[f_v], m_base.m_offset[f_v + 1]);
+	}
+	AdjIterator end(unsigned f_v) const
+	{
+		if(f_v >= V())
+			return AdjIterator(this, f_v, 0, 0);
+		unsigned e = m_base.m_offset[f_v + 1];
+		return AdjIterator(this, f_v, e, e);
+	}
+
+	// ================================
+public:
+	CSGraphSnapshot(const CSGraph& f_g):
+		CGraph(f_g.V()),
+		m_base(f_g),
+		m_dead(f_g.m_adj.size()),
+		m_first(f_g.m_offset.begin(), f_g.m_offset.end() - 1)
+	{
+		m_degree = f_g.m_degree;
+		m_E = f_g.E();
+	}
+
+	const CSGraph& base() const { return m_base; }
+
+	// Same contract as CEGraph::remove(): the iterator is invalidated.
+	// O(1): slots die in twin pairs, so the twin of a live slot is live
+	void remove(AdjIterator& f_it)
+	{
+		unsigned v = f_it.m_v;
+		unsigned w = *f_it;
+		kill(v, f_it.m_slot);
+		kill(w, m_base.m_twin[f_it.m_slot]);
+
+		m_degree[v]--;
+		m_degree[w]--;
+		m_E--;
+	}
+
+private:
+	unsigned next(unsigned f_slot, unsigned f_end) const
+	{
+		while(f_slot < f_end && m_dead[f_slot])
+			f_slot++;
+		return f_slot;
+	}
+	void kill(unsigned f_v, unsigned f_slot)
+	{
+		m_dead[f_slot] = true;
+		// Keep begin() O(1) for the edge-consuming algorithms
+		if(f_slot == m_first[f_v])
+			m_first[f_v] = next(f_slot + 1, m_base.m_offset[f_v + 1]);
+	}
+
+	void print(std::ostream& f_os) const
+	{
+		for(unsigned v = 0, n = V(); v < n; v++)
+		{
+			f_os << v << ':';
+			for(AdjIterator it = begin(v), end = this->end(v); it != end; ++it)
+				f_os << ' ' << *it;
+			f_os << std::endl;
+		}
+	}
+
+private:
+	const CSGraph& m_base;
+	// Tombstones per adjacency slot of the base
+	std::vector<bool> m_dead;
+	// The first live slot of every vertex
+	std::vector<unsigned> m_first;
+};
+
+// ============================================================================
+// Snapshot of any other graph: flattened once into a private CSGraph, O(V + E)
+// without the per-edge allocations of a deep copy, then the same overlay
+template<class G>
+class CSGraphFlatSnapshot;
+
+class CSGraphFlat
+{
+	template<class G>
+	friend class CSGraphFlatSnapshot;
+
+	template<class G>
+	explicit CSGraphFlat(const G& f_g): m_flat(f_g) {}
+
+	CSGraph m_flat;
+};
+
+// The flattened graph is a base so that it is built before the overlay
+template<class G>
+class CSGraphFlatSnapshot : private CSGraphFlat, public CSGraphSnapshot
+{
+public:
+	explicit CSGraphFlatSnapshot(const G& f_g):
+		CSGraphFlat(f_g),
+		CSGraphSnapshot(m_flat)
+	{}
+
+private:
+	CSGraphFlatSnapshot(const CSGraphFlatSnapshot&);
+	CSGraphFlatSnapshot& operator=(const CSGraphFlatSnapshot&);
+};
+
+// ============================================================================
+// A working copy for algorithms which remove edges: an overlay over
+// the immutable graph, flattened first for any other graph
+template<class G>
+struct graph_snapshot
+{
+	typedef CSGraphFlatSnapshot<G> type;
+};
+
+template<>
+struct graph_snapshot<CSGraph>
+{
+	typedef CSGraphSnapshot type;
+};
+
+#endif // __GRAPH_SNAPSHOT__
@@ -9,6 +9,107 @@ typedef bool (*traverse_cb_t)(void* f_param, unsigned f_v, unsigned f_w);
 
 typedef std::pair<unsigned, unsigned> edge_t;
 
+typedef std::list<edge_t> fringe_dfs_t;
+typedef std::queue<edge_t> fringe_bfs_t;
+
+// ============================================================================
+// Instrumentation (compile with -DGRAPH_TRAVERSE_STATS to enable).
+// Counters are accumulated over all traverse() calls of a traverser;
+// level sizes are summed per depth and only collected for BFS fringes.
+#ifdef GRAPH_TRAVERSE_STATS
+#include <chrono>
+#include <ostream>
+#include <type_traits>
+
+#define TRAVERSE_STAT(...) __VA_ARGS__
+
+struct CTraverseStats
+{
+	typedef std::chrono::steady_clock Clock;
+
+	enum Phase { PhasePop, PhaseVisit, PhaseExpand, PhaseCount };
+
+	unsigned long long Popped;		// vertices taken from the fringe
+	unsigned long long Edges;		// adjacency entries examined
+	unsigned long long Duplicates;	// BFS: pushes avoided via m_queued
+	unsigned long long Repushes;	// DFS: queued vertices moved to the top of the stack
+	unsigned long long MaxFringe;
+	std::vector<unsigned long long> Levels;
+	unsigned long long Nanoseconds[PhaseCount];
+
+	CTraverseStats(): Popped(0), Edges(0), Duplicates(0), Repushes(0), MaxFringe(0), m_depth(0), m_left(0), m_next(0)
+	{
+		for(unsigned i = 0; i < PhaseCount; i++)
+			Nanoseconds[i] = 0;
+	}
+
+	// The source makes the level 0 (BFS only, as in expand())
+	void start(bool f_levels)
+	{
+		m_depth = 0;
+		m_left = 1;
+		m_next = 0;
+		if(f_levels)
+			level(1);
+		if(!MaxFringe)
+			MaxFringe = 1;
+	}
+	// Account the time since f_t to the phase and return the current time
+	Clock::time_point lap(Phase f_phase, Clock::time_point f_t)
+	{
+		Clock::time_point now = Clock::now();
+		Nanoseconds[f_phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - f_t).count();
+		return now;
+	}
+	// Called once per popped vertex after its neighbours are pushed
+	void expand(size_t f_fringe, size_t f_pushed, bool f_levels)
+	{
+		if(f_fringe > MaxFringe)
+			MaxFringe = f_fringe;
+		if(!f_levels)
+			return;
+		m_next += f_pushed;
+		if(--m_left)
+			return;
+		m_left = m_next;
+		m_next = 0;
+		m_depth++;
+		if(m_left)
+			level(m_left);
+	}
+
+	void dump(std::ostream& f_os) const
+	{
+		f_os << "{\"popped\":" << Popped
+			 << ",\"edges\":" << Edges
+			 << ",\"duplicates\":" << Duplicates
+			 << ",\"repushes\":" << Repushes
+			 << ",\"max_fringe\":" << MaxFringe
+			 << ",\"levels\":[";
+		for(unsigned i = 0, n = Levels.size(); i < n; i++)
+			f_os << (i ? "," : "") << Levels[i];
+		f_os << "],\"ns\":{\"pop\":" << Nanoseconds[PhasePop]
+			 << ",\"visit\":" << Nanoseconds[PhaseVisit]
+			 << ",\"expand\":" << Nanoseconds[PhaseExpand] << "}}";
+	}
+
+private:
+	void level(unsigned long long f_size)
+	{
+		if(Levels.size() <= m_depth)
+			Levels.push_back(0);
+		Levels[m_depth] += f_size;
+	}
+
+private:
+	unsigned m_depth;
+	unsigned long long m_left;
+	unsigned long long m_next;
+};
+#else
+#define TRAVERSE_STAT(...)
+#endif
+
 // ============================================================================
 // Generic traverse scheme
 template<class G, class FRINGE>
@@ -22,12 +123,14 @@ public:
 
 		FRINGE s;
 		push_if(s, f_v, f_v);
+		TRAVERSE_STAT(m_stats.start(std::is_same<FRINGE, fringe_bfs_t>::value); CTraverseStats::Clock::time_point t = CTraverseStats::Clock::now());
 
 		for(unsigned pre = 0; !s.empty(); pre++)
 		{
 			// Pop
 			edge_t e = pop(s);
 			unsigned w = e.second;
+			TRAVERSE_STAT(m_stats.Popped++; t = m_stats.lap(CTraverseStats::PhasePop, t));
 
 			// Order
 			m_pre[pre] = w;
@@ -36,12 +139,19 @@ public:
 			unsigned parent = e.first;
 			bool cont = f_cb ? f_cb(f_param, parent, w) : true;
 			m_parent[w] = parent + 1;
+			TRAVERSE_STAT(t = m_stats.lap(CTraverseStats::PhaseVisit, t));
 			if(!cont)
 				break;
 
 			// Handle linked
+			TRAVERSE_STAT(size_t n = s.size());
 			for(typename G::AdjIterator it = m_g.begin(w), end = m_g.end(w); it != end; ++it)
+			{
+				TRAVERSE_STAT(m_stats.Edges++);
 				push_if(s, w, *it);
+			}
+			TRAVERSE_STAT(m_stats.expand(s.size(), s.size() - n, std::is_same<FRINGE, fringe_bfs_t>::value);
+						  t = m_stats.lap(CTraverseStats::PhaseExpand, t));
 		}
 	}
 
@@ -49,6 +159,8 @@ public:
 	unsigned parent(unsigned f_v) const { return m_parent.at(f_v) - 1; }
 	bool visited(unsigned f_v) const { return m_parent.at(f_v); }
 
+	TRAVERSE_STAT(const CTraverseStats& stats() const { return m_stats; })
+
 protected:
 	CGraphTraverse(const G& f_g): m_g(f_g), m_pre(f_g.V()), m_parent(f_g.V()), m_queued(f_g.V()) {}
 	virtual ~CGraphTraverse() {}
@@ -62,12 +174,12 @@ protected:
 	std::vector<unsigned> m_pre;
 	std::vector<unsigned> m_parent;
 	std::vector<bool> m_queued;
+
+	TRAVERSE_STAT(CTraverseStats m_stats;)
 };
 
 // ============================================================================
 // DFS (fringe = stack)
-typedef std::list<edge_t> fringe_dfs_t;
-
 template<class G>
 class CGraphDFS : public CGraphTraverse<G, fringe_dfs_t>
 {
@@ -90,7 +202,10 @@ protected:
 		}
 		// Delete previous item in "stack" if was pushed
 		if(this->m_queued[f_w])
+		{
 			f_s.erase(m_it[f_w]);
+			TRAVERSE_STAT(this->m_stats.Repushes++);
+		}
 		f_s.push_front( edge_t(f_v, f_w) );
 		m_it[f_w] = f_s.begin();
 		this->m_queued[f_w] = true;
@@ -109,8 +224,6 @@ private:
 
 // ============================================================================
 // BFS (fringe = queue)
-typedef std::queue<edge_t> fringe_bfs_t;
-
 template<class G>
 class CGraphBFS : public CGraphTraverse<G, fringe_bfs_t>
 {
@@ -121,11 +234,13 @@ public:
 protected:
 	virtual void push_if(fringe_bfs_t& f_s, unsigned f_v, unsigned f_w)
 	{
-		if(!this->m_queued[f_w])
+		if(this->m_queued[f_w])
 		{
-			f_s.push( edge_t(f_v, f_w) );
-			this->m_queued[f_w] = true;
+			TRAVERSE_STAT(this->m_stats.Duplicates++);
+			return;
 		}
+		f_s.push( edge_t(f_v, f_w) );
+		this->m_queued[f_w] = true;
 	}
 	virtual edge_t pop(fringe_bfs_t& f_s)
 	{
@@ -0,0 +1,56 @@
+#ifndef __GRAPH_UF__
+#define __GRAPH_UF__
+
+#include <vector>
+#include <algorithm>
+
+
+// ============================================================================
+// Union-Find (disjoint sets) with union by rank and path halving
+class CUnionFind
+{
+public:
+	CUnionFind(unsigned f_n): m_parent(f_n), m_rank(f_n)
+	{
+		for(unsigned i = 0; i < f_n; i++)
+			m_parent[i] = i;
+	}
+
+	unsigned find(unsigned f_v)
+	{
+		while(m_parent[f_v] != f_v)
+		{
+			m_parent[f_v] = m_parent[m_parent[f_v]];
+			f_v = m_parent[f_v];
+		}
+		return f_v;
+	}
+	// Read-only lookup: safe for concurrent readers while nobody unites
+	unsigned root(unsigned f_v) const
+	{
+		while(m_parent[f_v] != f_v)
+			f_v = m_parent[f_v];
+		return f_v;
+	}
+
+	// Return false if already in the same set
+	bool unite(unsigned f_v, unsigned f_w)
+	{
+		f_v = find(f_v);
+		f_w = find(f_w);
+		if(f_v == f_w)
+			return false;
+		if(m_rank[f_v] < m_rank[f_w])
+			std::swap(f_v, f_w);
+		m_parent[f_w] = f_v;
+		if(m_rank[f_v] == m_rank[f_w])
+			m_rank[f_v]++;
+		return true;
+	}
+
+private:
+	std::vector<unsigned> m_parent;
+	std::vector<unsigned char> m_rank;
+};
+
+#endif // __GRAPH_UF__
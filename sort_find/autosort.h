@@ -0,0 +1,338 @@
+#ifndef __AUTOSORT_H__
+#define __AUTOSORT_H__
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <ostream>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+#include <stdint.h>
+
+#include "sort.h"
+#include "radix.h"
+
+
+// ============================================================================
+// Sort Dispatcher
+//
+// sort_auto looks at a sample of the input and picks the kernel:
+// - sort_tim when the sampled neighbours are (nearly) all in order, or all
+//   in reverse order: the natural runs make it close to linear;
+// - sort_counting for integers from a range not much wider than the count;
+// - sort_radix for the other arithmetic items compared with <, unless they
+//   are too few or have too few distinct values;
+// - sort_pdq otherwise.
+// The counting and the radix sort need a pointer to arithmetic items and
+// the default comparator. The result is not stable.
+//
+// The thresholds are in sort_auto_config(); sort_auto_calibrate() sets them
+// by timing the kernels on this machine, sort_auto_save() and
+// sort_auto_load() keep them in a file for the next runs on the same
+// machine. sort_auto returns the plan it followed, so the callers can log
+// the decisions.
+
+// What the sample showed and what was chosen
+struct SortPlan
+{
+	const char* Kernel;
+	size_t N;
+	double Disorder;	// sampled neighbours out of order (or in order, whichever is less)
+	double Distinct;	// distinct items in the sample
+	uint64_t Range;		// max - min + 1 of the integers (0: not checked)
+};
+
+inline std::ostream& operator<<(std::ostream& f_os, const SortPlan& f_plan)
+{
+	f_os << f_plan.Kernel << " (n " << f_plan.N << ", disorder " << f_plan.Disorder
+		 << ", distinct " << f_plan.Distinct;
+	if(f_plan.Range)
+		f_os << ", range " << f_plan.Range;
+	return f_os << ')';
+}
+
+struct SortAutoConfig
+{
+	SortAutoConfig(): RadixMin(1 << 12), RadixDistinct(0.1), CountingRange(4.0), Presorted(0.01) {}
+
+	size_t RadixMin;		// fewer items go to sort_pdq
+	double RadixDistinct;	// fewer distinct items in the sample go to sort_pdq
+	double CountingRange;	// integers spanning up to n * CountingRange values go to sort_counting
+	double Presorted;		// less disorder goes to sort_tim
+};
+
+// One configuration for the whole program
+inline SortAutoConfig& sort_auto_config()
+{
+	static SortAutoConfig cfg;
+	return cfg;
+}
+
+enum
+{
+	AutoSample = 1024,	// neighbour pairs and items sampled
+	AutoSmall = 64		// fewer items are not worth sampling: sort_pdq
+};
+
+// The kernels that need a pointer to arithmetic items and std::less
+template<class Iter, class Compare>
+struct sort_auto_radix: std::integral_constant<bool,
+	std::is_pointer<Iter>::value &&
+	std::is_arithmetic<typename std::iterator_traits<Iter>::value_type>::value &&
+	std::is_same<Compare, std::less<typename std::iterator_traits<Iter>::value_type> >::value> {};
+
+template<class Iter, class Compare>
+SortPlan sort_auto_profile(Iter a, size_t n, Compare comp)
+{
+	typedef typename std::iterator_traits<Iter>::value_type Item;
+	SortPlan plan = { "sort_pdq", n, 1.0, 1.0, 0 };
+	if(n < AutoSmall)
+		return plan;
+
+	// Random positions: evenly spaced ones would alias with periodic inputs
+	uint64_t seed = 0x9E3779B97F4A7C15ull ^ n;
+	auto pick = [&seed](size_t m) { seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17; return (size_t)(seed % m); };
+
+	// Presortedness: pairs of neighbours
+	size_t down = 0, up = 0;
+	for(size_t s = 0; s < AutoSample; s++)
+	{
+		size_t i = pick(n - 1);
+		down += comp(a[i + 1], a[i]);
+		up += comp(a[i], a[i + 1]);
+	}
+	plan.Disorder = (double)std::min(down, up) / AutoSample;
+
+	// Duplicates: the sorted sample
+	std::vector<Item> sample(AutoSample);
+	for(size_t s = 0; s < sample.size(); s++)
+		sample[s] = a[pick(n)];
+	sort_pdq(&sample[0], sample.size(), comp);
+	size_t distinct = 1;
+	for(size_t s = 1; s < sample.size(); s++)
+		distinct += comp(sample[s - 1], sample[s]);
+	plan.Distinct = (double)distinct / sample.size();
+	return plan;
+}
+
+// Any iterator and comparator: merge or quick sort
+template<class Iter, class Compare>
+static void sort_auto_run(Iter a, size_t n, Compare comp, SortPlan& plan, std::false_type)
+{
+	if(plan.Disorder < sort_auto_config().Presorted)
+	{
+		plan.Kernel = "sort_tim";
+		sort_tim(a, n, comp);
+	}
+	else
+		sort_pdq(a, n, comp);
+}
+
+// The exact range of the integers, if it is narrower than the limit; a few
+// spaced items usually show a wide range before the full pass
+template<class Item>
+static bool sort_auto_range(const Item* a, size_t n, double limit, Item& lo, Item& hi, std::true_type)
+{
+	typedef radix_key<Item> RK;
+	lo = hi = a[0];
+	for(size_t step = n / AutoSmall + 1;; step = 1)
+	{
+		for(size_t i = 0; i < n; i += step)
+		{
+			lo = std::min(lo, a[i]);
+			hi = std::max(hi, a[i]);
+		}
+		if((double)(RK::map(hi) - RK::map(lo)) >= limit)
+			return false;
+		if(step == 1)
+			return true;
+	}
+}
+
+template<class Item>
+static bool sort_auto_range(const Item*, size_t, double, Item&, Item&, std::false_type)
+{
+	return false;
+}
+
+template<class Item>
+static void sort_auto_counting(Item* a, size_t n, Item lo, Item hi, std::true_type)
+{
+	sort_counting(a, n, lo, hi);
+}
+
+template<class Item>
+static void sort_auto_counting(Item*, size_t, Item, Item, std::false_type) {}
+
+// Pointer to arithmetic items, std::less: all the kernels
+template<class Item, class Compare>
+static void sort_auto_run(Item* a, size_t n, Compare comp, SortPlan& plan, std::true_type)
+{
+	typedef std::is_integral<Item> Integral;
+	const SortAutoConfig& cfg = sort_auto_config();
+	Item lo = Item(), hi = Item();
+	if(n < AutoSmall || plan.Disorder < cfg.Presorted)
+	{
+		sort_auto_run(a, n, comp, plan, std::false_type());
+		return;
+	}
+	if(sort_auto_range(a, n, n * cfg.CountingRange, lo, hi, Integral()))
+	{
+		typedef radix_key<Item> RK;
+		plan.Kernel = "sort_counting";
+		plan.Range = (uint64_t)(RK::map(hi) - RK::map(lo)) + 1;
+		sort_auto_counting(a, n, lo, hi, Integral());
+		return;
+	}
+	if(n >= cfg.RadixMin && plan.Distinct >= cfg.RadixDistinct)
+	{
+		plan.Kernel = "sort_radix";
+		sort_radix(a, n);
+		return;
+	}
+	sort_pdq(a, n, comp);
+}
+
+template<class Iter, class Compare = typename sort_less<Iter>::type>
+SortPlan sort_auto(Iter a, size_t n, Compare comp = Compare())
+{
+	SortPlan plan = sort_auto_profile(a, n, comp);
+	sort_auto_run(a, n, comp, plan, sort_auto_radix<Iter, Compare>());
+	return plan;
+}
+
+// ====================================
+// Calibration: the crossovers of the kernels on random 32-bit integers,
+// timed on this machine up to n items. The thresholds are compared with
+// what the profile of the test input shows, not with its parameters, so
+// the sampling error is calibrated in.
+template<class F>
+static double sort_auto_time(const std::vector<int>& src, F sort)
+{
+	// Best of 3 runs, more for the small inputs
+	double best = 0, total = 0;
+	for(unsigned r = 0; r < 3 || (total < 0.01 && r < 1000); r++)
+	{
+		std::vector<int> a(src);
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		sort(&a[0], a.size());
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if(!r || sec < best)
+			best = sec;
+		total += sec;
+	}
+	return best;
+}
+
+inline void sort_auto_calibrate(size_t n = 1 << 20)
+{
+	SortAutoConfig& cfg = sort_auto_config();
+	uint64_t seed = 0x2545F4914F6CDD1Dull;
+	auto rnd = [&seed]() { seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17; return seed; };
+	auto pdq = [](int* p, size_t m) { sort_pdq(p, m); };
+	auto radix = [](int* p, size_t m) { sort_radix(p, m); };
+
+	// Radix against pdq by the count
+	cfg.RadixMin = n;
+	for(size_t m = AutoSmall; m <= n; m *= 2)
+	{
+		std::vector<int> a(m);
+		for(size_t i = 0; i < m; i++)
+			a[i] = (int)rnd();
+		if(sort_auto_time(a, radix) < sort_auto_time(a, pdq))
+		{
+			cfg.RadixMin = m;
+			break;
+		}
+	}
+
+	// Radix against pdq by the duplicates
+	std::vector<int> a(n);
+	cfg.RadixDistinct = 0;
+	for(size_t k = 2; k <= n; k *= 4)
+	{
+		std::vector<int> values(k);
+		for(size_t i = 0; i < k; i++)
+			values[i] = (int)rnd();
+		for(size_t i = 0; i < n; i++)
+			a[i] = values[rnd() % k];
+		if(sort_auto_time(a, radix) < sort_auto_time(a, pdq))
+			break;
+		cfg.RadixDistinct = sort_auto_profile(&a[0], n, std::less<int>()).Distinct * 1.01;
+	}
+
+	// Counting against radix by the width of the range
+	cfg.CountingRange = 0;
+	for(double w = 1.0 / 16; w <= 64; w *= 2)
+	{
+		size_t range = std::max<size_t>(1, (size_t)(n * w));
+		for(size_t i = 0; i < n; i++)
+			a[i] = (int)(rnd() % range);
+		int hi = (int)range - 1;
+		auto counting = [hi](int* p, size_t m) { sort_counting(p, m, 0, hi); };
+		if(sort_auto_time(a, counting) >= sort_auto_time(a, radix))
+			break;
+		cfg.CountingRange = w * 1.01;
+	}
+
+	// TimSort against the best of the rest by the disorder: sorted input
+	// with a growing share of the items replaced by random ones
+	cfg.Presorted = 0;
+	for(size_t d = n / 2; d >= 2; d /= 2)
+	{
+		for(size_t i = 0; i < n; i++)
+			a[i] = (i % d) ? (int)i : (int)(rnd() % n);
+		auto tim = [](int* p, size_t m) { sort_tim(p, m); };
+		if(sort_auto_time(a, tim) >= std::min(sort_auto_time(a, radix), sort_auto_time(a, pdq)))
+			break;
+		cfg.Presorted = sort_auto_profile(&a[0], n, std::less<int>()).Disorder * 1.01 + 1e-9;
+	}
+}
+
+// The machine the thresholds were measured on: the format version, the
+// hardware threads and the SIMD lanes the sorts were built with. A file
+// saved with another tag is not loaded, so the caller calibrates again.
+inline void sort_auto_tag(char* buf, size_t size)
+{
+#ifdef SORT_SIMD_LANES
+	unsigned lanes = SORT_SIMD_LANES;
+#else
+	unsigned lanes = 0;
+#endif
+	snprintf(buf, size, "sort_auto/1 threads=%u lanes=%u", hw_threads(), lanes);
+}
+
+// The tag and the calibrated thresholds as two lines of text; false on
+// errors (the configuration is left as is when the file can't be read or
+// parsed, or was saved on another machine)
+inline bool sort_auto_save(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	if(!f)
+		return false;
+	char tag[64];
+	sort_auto_tag(tag, sizeof(tag));
+	const SortAutoConfig& cfg = sort_auto_config();
+	bool ok = fprintf(f, "%s\n%zu %.17g %.17g %.17g\n", tag, cfg.RadixMin, cfg.RadixDistinct, cfg.CountingRange, cfg.Presorted) > 0;
+	return !fclose(f) && ok;
+}
+
+inline bool sort_auto_load(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if(!f)
+		return false;
+	char tag[64], saved[64];
+	sort_auto_tag(tag, sizeof(tag));
+	SortAutoConfig cfg;
+	bool ok = fgets(saved, sizeof(saved), f) && !strncmp(saved, tag, strlen(tag)) && (saved[strlen(tag)] == '\n') &&
+		fscanf(f, "%zu %lg %lg %lg", &cfg.RadixMin, &cfg.RadixDistinct, &cfg.CountingRange, &cfg.Presorted) == 4;
+	fclose(f);
+	if(ok)
+		sort_auto_config() = cfg;
+	return ok;
+}
+
+#endif // __AUTOSORT_H__
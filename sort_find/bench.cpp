@@ -0,0 +1,577 @@
+/**
+ * Sorting benchmark
+ *
+ * Every sort of sort.h, radix.h, psort.h and autosort.h next to std::sort
+ * and std::stable_sort over several element types, input distributions
+ * and sizes. Prints CSV: algorithm,type,distribution,n,seed,ns_per_item,ok
+ *
+ * g++ -std=c++11 -O2 -march=native -pthread bench.cpp -o bench
+ * ./bench [min=16] [max=16M] [step=8] [seed=1] [reps=3]
+ *         [types=int32,int64,double,rec16,string]
+ *         [dists=random,sorted,reversed,organ-pipe,few-unique,zipf,almost-sorted,narrow]
+ *         [algs=sort_pdq,std::sort,...] [out=file.csv]
+ *
+ * The sizes go from min to max multiplying by step (max itself included,
+ * e.g. max=1e9). The quadratic sorts are limited to small inputs, the
+ * plain quick sorts (last item pivot) to random inputs above that, the
+ * counting sorts to keys spanning up to CountingSpan values (the narrow
+ * inputs: keys below n). sort_auto runs with the default thresholds.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#include "sort.h"
+#include "radix.h"
+#include "psort.h"
+#include "autosort.h"
+
+
+// ====================================
+// Repeatable random numbers (splitmix64)
+class CRand
+{
+public:
+	CRand(uint64_t f_seed): m_s(f_seed) {}
+
+	uint64_t operator()()
+	{
+		uint64_t z = (m_s += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+	// [0, n)
+	uint64_t below(uint64_t n) { return (*this)() % n; }
+	// [0, 1)
+	double real() { return ((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+	uint64_t m_s;
+};
+
+// ====================================
+// Element types
+struct Rec16
+{
+	uint64_t Key;
+	uint64_t Payload;
+
+	bool operator<(const Rec16& r) const { return Key < r.Key; }
+	bool operator>(const Rec16& r) const { return Key > r.Key; }
+	bool operator<=(const Rec16& r) const { return Key <= r.Key; }
+	bool operator>=(const Rec16& r) const { return Key >= r.Key; }
+	bool operator==(const Rec16& r) const { return Key == r.Key; }
+	bool operator!=(const Rec16& r) const { return Key != r.Key; }
+};
+
+// A large record: copies are expensive, moves are not cheaper
+struct Rec64
+{
+	uint64_t Key;
+	uint64_t Payload[7];
+
+	bool operator<(const Rec64& r) const { return Key < r.Key; }
+	bool operator>(const Rec64& r) const { return Key > r.Key; }
+	bool operator<=(const Rec64& r) const { return Key <= r.Key; }
+	bool operator>=(const Rec64& r) const { return Key >= r.Key; }
+	bool operator==(const Rec64& r) const { return Key == r.Key; }
+	bool operator!=(const Rec64& r) const { return Key != r.Key; }
+};
+
+template<class T> struct TypeInfo;
+template<> struct TypeInfo<int32_t>
+{
+	static const char* name() { return "int32"; }
+	static int32_t make(uint64_t r, uint64_t) { return (int32_t)r; }
+};
+template<> struct TypeInfo<int64_t>
+{
+	static const char* name() { return "int64"; }
+	static int64_t make(uint64_t r, uint64_t) { return (int64_t)r; }
+};
+template<> struct TypeInfo<double>
+{
+	static const char* name() { return "double"; }
+	static double make(uint64_t r, uint64_t) { return ((r >> 11) * (1.0 / 9007199254740992.0) - 0.5) * 1e6; }
+};
+template<> struct TypeInfo<Rec16>
+{
+	static const char* name() { return "rec16"; }
+	static Rec16 make(uint64_t r, uint64_t i) { Rec16 x = { r, i }; return x; }
+};
+template<> struct TypeInfo<Rec64>
+{
+	static const char* name() { return "rec64"; }
+	static Rec64 make(uint64_t r, uint64_t i)
+	{
+		Rec64 x;
+		x.Key = r;
+		for(unsigned j = 0; j < 7; j++)
+			x.Payload[j] = i + j;
+		return x;
+	}
+};
+template<> struct TypeInfo<std::string>
+{
+	static const char* name() { return "string"; }
+	// 8..23 letters, a common prefix for a quarter of them
+	static std::string make(uint64_t r, uint64_t)
+	{
+		CRand rnd(r);
+		std::string s((r & 3) ? "" : "prefix/");
+		for(unsigned i = 0, n = 8 + (unsigned)(r >> 60); i < n; i++)
+			s += (char)('a' + rnd.below(26));
+		return s;
+	}
+};
+
+// A total order over all the bytes of an item (payloads and the signs of
+// zeros included): two ranges hold the same items if they are equal once
+// sorted by it
+template<class T>
+struct ExactLess
+{
+	bool operator()(const T& x, const T& y) const { return memcmp(&x, &y, sizeof(T)) < 0; }
+};
+template<> struct ExactLess<std::string>: std::less<std::string> {};
+
+// Is [a, a + exact.size()) a permutation of the items in exact (sorted by ExactLess)?
+template<class T>
+static bool same_items(const T* a, const std::vector<T>& exact)
+{
+	ExactLess<T> less;
+	std::vector<T> b(a, a + exact.size());
+	std::sort(b.begin(), b.end(), less);
+	for(size_t i = 0; i < b.size(); i++)
+	{
+		if(less(b[i], exact[i]) || less(exact[i], b[i]))
+			return false;
+	}
+	return true;
+}
+
+// ====================================
+// Input distributions
+enum Dist { DistRandom, DistSorted, DistReversed, DistOrganPipe, DistFewUnique, DistZipf, DistAlmostSorted, DistNarrow, DistCount };
+
+static const char* dist_names[DistCount] =
+{
+	"random", "sorted", "reversed", "organ-pipe", "few-unique", "zipf", "almost-sorted", "narrow"
+};
+
+enum { FewUnique = 16, ZipfValues = 1 << 16 };
+
+// Zipf (s = 1) ranks over [0, m) by the inverse of the tabulated CDF
+class CZipf
+{
+public:
+	CZipf(size_t f_m): m_cdf(f_m)
+	{
+		double sum = 0;
+		for(size_t i = 0; i < f_m; i++)
+			m_cdf[i] = (sum += 1.0 / (i + 1));
+		for(size_t i = 0; i < f_m; i++)
+			m_cdf[i] /= sum;
+	}
+
+	size_t operator()(CRand& f_rand) const
+	{
+		size_t i = std::upper_bound(m_cdf.begin(), m_cdf.end(), f_rand.real()) - m_cdf.begin();
+		return std::min(i, m_cdf.size() - 1);
+	}
+
+private:
+	std::vector<double> m_cdf;
+};
+
+template<class T>
+static void make_input(std::vector<T>& a, size_t n, Dist d, uint64_t seed)
+{
+	typedef TypeInfo<T> Info;
+	CRand rnd(seed);
+	a.resize(n);
+
+	if(d == DistFewUnique || d == DistZipf)
+	{
+		// Values from a small pool
+		std::vector<T> pool(std::min<size_t>((d == DistZipf) ? ZipfValues : FewUnique, std::max<size_t>(n, 1)));
+		for(size_t i = 0; i < pool.size(); i++)
+			pool[i] = Info::make(rnd(), i);
+		CZipf zipf((d == DistZipf) ? pool.size() : 1);
+		for(size_t i = 0; i < n; i++)
+			a[i] = pool[(d == DistZipf) ? zipf(rnd) : rnd.below(pool.size())];
+		return;
+	}
+
+	for(size_t i = 0; i < n; i++)
+		a[i] = Info::make((d == DistNarrow) ? rnd.below(std::max<size_t>(n, 1)) : rnd(), i);
+	if(d == DistRandom || d == DistNarrow)
+		return;
+
+	std::sort(a.begin(), a.end());
+	switch(d)
+	{
+		case DistReversed:
+			std::reverse(a.begin(), a.end());
+			break;
+		case DistOrganPipe:
+		{
+			// Even ranks ascending, then odd ranks descending
+			std::vector<T> b(a);
+			for(size_t i = 0; 2 * i < n; i++)
+				a[i] = b[2 * i];
+			for(size_t i = 0; 2 * i + 1 < n; i++)
+				a[n - 1 - i] = b[2 * i + 1];
+			break;
+		}
+		case DistAlmostSorted:
+			for(size_t i = 0, swaps = std::max<size_t>(1, n / 100); n && i < swaps; i++)
+				std::swap(a[rnd.below(n)], a[rnd.below(n)]);
+			break;
+		default:
+			break;
+	}
+}
+
+// ====================================
+// Algorithms
+enum
+{
+	QuadraticLimit = 1 << 14,	// sel/ins/bub on any input
+	QuickLimit = 1 << 14,		// last-item pivot quick sorts on non-random input
+	CountingSpan = 1 << 24		// counting sorts: the widest hi - lo of the keys
+};
+
+static CTaskPool& pool()
+{
+	static CTaskPool p;
+	return p;
+}
+
+template<class T>
+struct Algorithm
+{
+	const char* Name;
+	void (*Sort)(T*, size_t);
+	size_t Limit;			// the largest n for any input
+	size_t NonRandomLimit;	// the largest n for non-random inputs
+	uint64_t Span;			// the widest hi - lo of the keys, 0 for any
+};
+
+template<class T>
+static void add_common(std::vector< Algorithm<T> >& f_algs)
+{
+	Algorithm<T> algs[] =
+	{
+		{ "std::sort", [](T* a, size_t n) { std::sort(a, a + n); }, ~(size_t)0, ~(size_t)0 },
+		{ "std::stable_sort", [](T* a, size_t n) { std::stable_sort(a, a + n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_sel", [](T* a, size_t n) { sort_sel(a, n); }, QuadraticLimit, QuadraticLimit },
+		{ "sort_ins", [](T* a, size_t n) { sort_ins(a, n); }, QuadraticLimit, QuadraticLimit },
+		{ "sort_bub", [](T* a, size_t n) { sort_bub(a, n); }, QuadraticLimit, QuadraticLimit },
+		{ "sort_shell", [](T* a, size_t n) { sort_shell(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_quick", [](T* a, size_t n) { sort_quick(a, n); }, ~(size_t)0, QuickLimit },
+		{ "sort_quick3", [](T* a, size_t n) { sort_quick3(a, n); }, ~(size_t)0, QuickLimit },
+		{ "sort_merge", [](T* a, size_t n) { sort_merge(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_heap", [](T* a, size_t n) { sort_heap(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_heap_dary<2>", [](T* a, size_t n) { sort_heap_dary<2>(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_heap_dary<4>", [](T* a, size_t n) { sort_heap_dary<4>(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_heap_dary<8>", [](T* a, size_t n) { sort_heap_dary<8>(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_pdq", [](T* a, size_t n) { sort_pdq(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_merge_stable", [](T* a, size_t n) { sort_merge_stable(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_tim", [](T* a, size_t n) { sort_tim(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_quick_parallel", [](T* a, size_t n) { sort_quick_parallel(a, n, pool()); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_sample", [](T* a, size_t n) { sort_sample(a, n, pool()); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_merge_parallel", [](T* a, size_t n) { sort_merge_parallel(a, n, pool()); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_heap_parallel", [](T* a, size_t n) { sort_heap_parallel(a, n, pool()); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_auto", [](T* a, size_t n) { sort_auto(a, n); }, ~(size_t)0, ~(size_t)0 }
+	};
+	f_algs.insert(f_algs.end(), algs, algs + sizeof(algs) / sizeof(*algs));
+}
+
+// Radix sorts: arithmetic keys and the records by their key
+template<class T>
+static void add_radix(std::vector< Algorithm<T> >& f_algs, typename std::enable_if<std::is_arithmetic<T>::value>::type* = NULL)
+{
+	Algorithm<T> algs[] =
+	{
+		{ "sort_radix", [](T* a, size_t n) { sort_radix(a, n); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_radix (MT)", [](T* a, size_t n) { sort_radix(a, n, hw_threads()); }, ~(size_t)0, ~(size_t)0 }
+	};
+	f_algs.insert(f_algs.end(), algs, algs + sizeof(algs) / sizeof(*algs));
+}
+
+static void add_radix(std::vector< Algorithm<Rec16> >& f_algs)
+{
+	Algorithm<Rec16> algs[] =
+	{
+		{ "sort_radix", [](Rec16* a, size_t n) { sort_radix_by(a, n, [](const Rec16& r) { return r.Key; }); }, ~(size_t)0, ~(size_t)0 },
+		{ "sort_radix (MT)", [](Rec16* a, size_t n) { sort_radix_by(a, n, [](const Rec16& r) { return r.Key; }, hw_threads()); }, ~(size_t)0, ~(size_t)0 }
+	};
+	f_algs.insert(f_algs.end(), algs, algs + sizeof(algs) / sizeof(*algs));
+}
+
+static void add_radix(std::vector< Algorithm<Rec64> >& f_algs)
+{
+	Algorithm<Rec64> algs[] =
+	{
+		{ "sort_radix", [](Rec64* a, size_t n) { sort_radix_by(a, n, [](const Rec64& r) { return r.Key; }); }, ~(size_t)0, ~(size_t)0 }
+	};
+	f_algs.insert(f_algs.end(), algs, algs + sizeof(algs) / sizeof(*algs));
+}
+
+static void add_radix(std::vector< Algorithm<std::string> >&) {}
+
+// Counting sorts: integers and the records by their key, over the range
+// of the input (the min/max pass is timed too)
+template<class T, class KeyOf>
+static void sort_counting_range(T* a, size_t n, KeyOf key, bool flag)
+{
+	if(!n)
+		return;
+	typedef typename std::decay<decltype(key(*a))>::type Key;
+	Key lo = key(a[0]), hi = lo;
+	for(size_t i = 1; i < n; i++)
+	{
+		lo = std::min(lo, key(a[i]));
+		hi = std::max(hi, key(a[i]));
+	}
+	if(flag)
+		sort_flag_by(a, n, key, lo, hi);
+	else
+		sort_counting_by(a, n, key, lo, hi);
+}
+
+template<class T>
+static void add_counting(std::vector< Algorithm<T> >& f_algs, typename std::enable_if<std::is_integral<T>::value>::type* = NULL)
+{
+	Algorithm<T> algs[] =
+	{
+		{ "sort_counting", [](T* a, size_t n)
+			{
+				if(n)
+				{
+					std::pair<T*, T*> mm = std::minmax_element(a, a + n);
+					sort_counting(a, n, *mm.first, *mm.second);
+				}
+			}, ~(size_t)0, ~(size_t)0, CountingSpan },
+		{ "sort_flag_by", [](T* a, size_t n) { sort_counting_range(a, n, [](const T& x) { return x; }, true); }, ~(size_t)0, ~(size_t)0, CountingSpan }
+	};
+	f_algs.insert(f_algs.end(), algs, algs + sizeof(algs) / sizeof(*algs));
+}
+
+template<class T>
+static void add_counting(std::vector< Algorithm<T> >& f_algs, typename std::enable_if<std::is_same<T, Rec16>::value || std::is_same<T, Rec64>::value>::type* = NULL)
+{
+	Algorithm<T> algs[] =
+	{
+		{ "sort_counting_by", [](T* a, size_t n) { sort_counting_range(a, n, [](const T& r) { return r.Key; }, false); }, ~(size_t)0, ~(size_t)0, CountingSpan },
+		{ "sort_flag_by", [](T* a, size_t n) { sort_counting_range(a, n, [](const T& r) { return r.Key; }, true); }, ~(size_t)0, ~(size_t)0, CountingSpan }
+	};
+	f_algs.insert(f_algs.end(), algs, algs + sizeof(algs) / sizeof(*algs));
+}
+
+static void add_counting(std::vector< Algorithm<double> >&) {}
+static void add_counting(std::vector< Algorithm<std::string> >&) {}
+
+// hi - lo of the keys for the counting sorts
+template<class T>
+static uint64_t key_span(const std::vector<T>& a, typename std::enable_if<std::is_integral<T>::value>::type* = NULL)
+{
+	if(a.empty())
+		return 0;
+	typedef typename std::vector<T>::const_iterator It;
+	std::pair<It, It> mm = std::minmax_element(a.begin(), a.end());
+	return (uint64_t)*mm.second - (uint64_t)*mm.first;
+}
+
+template<class T>
+static uint64_t key_span(const std::vector<T>& a, typename std::enable_if<std::is_same<T, Rec16>::value || std::is_same<T, Rec64>::value>::type* = NULL)
+{
+	uint64_t lo = ~(uint64_t)0, hi = 0;
+	for(size_t i = 0; i < a.size(); i++)
+	{
+		lo = std::min(lo, a[i].Key);
+		hi = std::max(hi, a[i].Key);
+	}
+	return a.empty() ? 0 : hi - lo;
+}
+
+static uint64_t key_span(const std::vector<double>&) { return ~(uint64_t)0; }
+static uint64_t key_span(const std::vector<std::string>&) { return ~(uint64_t)0; }
+
+// ====================================
+struct Options
+{
+	Options(): Min(16), Max(16 << 20), Step(8), Seed(1), Reps(3) {}
+
+	size_t Min;
+	size_t Max;
+	size_t Step;
+	uint64_t Seed;
+	unsigned Reps;
+	std::vector<std::string> Types;
+	std::vector<std::string> Dists;
+	std::vector<std::string> Algs;
+
+	// Empty list: everything
+	static bool selected(const std::vector<std::string>& f_list, const std::string& f_name)
+	{
+		return f_list.empty() || std::find(f_list.begin(), f_list.end(), f_name) != f_list.end();
+	}
+};
+
+// Small inputs are sorted in batches of copies so that one timing covers
+// at least BatchItems items; the best of the repetitions is reported
+enum { BatchItems = 1 << 16 };
+
+template<class T>
+static void bench_type(const Options& opt, std::ostream& out)
+{
+	const char* type = TypeInfo<T>::name();
+	if(!Options::selected(opt.Types, type))
+		return;
+
+	std::vector< Algorithm<T> > algs;
+	add_common(algs);
+	add_radix(algs);
+	add_counting(algs);
+
+	std::vector<size_t> sizes;
+	for(size_t n = opt.Min; n < opt.Max; n *= opt.Step)
+		sizes.push_back(n);
+	sizes.push_back(opt.Max);
+
+	for(unsigned d = 0; d < DistCount; d++)
+	{
+		if(!Options::selected(opt.Dists, dist_names[d]))
+			continue;
+		for(size_t s = 0; s < sizes.size(); s++)
+		{
+			size_t n = sizes[s];
+			size_t batch = std::max<size_t>(1, BatchItems / std::max<size_t>(n, 1));
+			std::vector<T> input;
+			make_input(input, n, (Dist)d, opt.Seed + n);
+			std::vector<T> exact(input);
+			std::sort(exact.begin(), exact.end(), ExactLess<T>());
+			uint64_t span = key_span(input);
+
+			std::vector<T> work;
+			for(size_t i = 0; i < algs.size(); i++)
+			{
+				const Algorithm<T>& alg = algs[i];
+				if(!Options::selected(opt.Algs, alg.Name) || n > alg.Limit || (d != DistRandom && n > alg.NonRandomLimit) ||
+				   (alg.Span && span > alg.Span))
+					continue;
+
+				double best = 0;
+				bool ok = true;
+				for(unsigned r = 0; r < opt.Reps; r++)
+				{
+					work.clear();
+					for(size_t b = 0; b < batch; b++)
+						work.insert(work.end(), input.begin(), input.end());
+
+					std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+					for(size_t b = 0; b < batch; b++)
+						alg.Sort(&work[0] + b * n, n);
+					double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+					if(!r || sec < best)
+						best = sec;
+					// Sorted, and (once) the same items as the input
+					for(size_t b = 0; b < batch && ok; b++)
+					{
+						ok = std::is_sorted(work.begin() + b * n, work.begin() + (b + 1) * n) &&
+							 (r || same_items(&work[0] + b * n, exact));
+					}
+				}
+
+				out << alg.Name << ',' << type << ',' << dist_names[d] << ',' << n << ',' << opt.Seed << ','
+					<< best * 1e9 / ((double)n * batch) << ',' << (ok ? "OK" : "FAILED") << std::endl;
+			}
+		}
+	}
+}
+
+static std::vector<std::string> split(const std::string& f_s)
+{
+	std::vector<std::string> r;
+	std::stringstream ss(f_s);
+	for(std::string item; std::getline(ss, item, ',');)
+		r.push_back(item);
+	return r;
+}
+
+// 16M, 1e9, 4096
+static size_t parse_size(const std::string& f_s)
+{
+	char* end;
+	double v = strtod(f_s.c_str(), &end);
+	switch(*end)
+	{
+		case 'K': case 'k': v *= 1 << 10; break;
+		case 'M': case 'm': v *= 1 << 20; break;
+		case 'G': case 'g': v *= 1 << 30; break;
+	}
+	return (size_t)v;
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	std::string file;
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		std::string key = arg.substr(0, eq);
+		std::string val = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+
+		if(key == "min")		opt.Min = std::max<size_t>(1, parse_size(val));
+		else if(key == "max")	opt.Max = parse_size(val);
+		else if(key == "step")	opt.Step = std::max<size_t>(2, parse_size(val));
+		else if(key == "seed")	opt.Seed = strtoull(val.c_str(), NULL, 10);
+		else if(key == "reps")	opt.Reps = std::max(1, atoi(val.c_str()));
+		else if(key == "types")	opt.Types = split(val);
+		else if(key == "dists")	opt.Dists = split(val);
+		else if(key == "algs")	opt.Algs = split(val);
+		else if(key == "out")	file = val;
+		else
+		{
+			std::cerr << "Unknown option: " << arg << std::endl;
+			return 1;
+		}
+	}
+	opt.Max = std::max(opt.Max, opt.Min);
+
+	std::ofstream fout;
+	if(!file.empty())
+	{
+		fout.open(file.c_str());
+		if(!fout)
+		{
+			std::cerr << "Can't open " << file << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = file.empty() ? std::cout : fout;
+
+	out << "algorithm,type,distribution,n,seed,ns_per_item,ok" << std::endl;
+	bench_type<int32_t>(opt, out);
+	bench_type<int64_t>(opt, out);
+	bench_type<double>(opt, out);
+	bench_type<Rec16>(opt, out);
+	bench_type<Rec64>(opt, out);
+	bench_type<std::string>(opt, out);
+
+	return 0;
+}
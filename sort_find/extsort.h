@@ -0,0 +1,379 @@
+#ifndef __EXTSORT_H__
+#define __EXTSORT_H__
+
+#include <vector>
+#include <string>
+#include <future>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "psort.h"
+#include "kmerge.h"
+
+
+// Fixed-size record ordered by the bytes of its key prefix
+// (the sortbenchmark.org records are ExtRecord<100, 10>)
+template<size_t Size, size_t KeySize = Size>
+struct ExtRecord
+{
+	unsigned char Bytes[Size];
+
+	bool operator<(const ExtRecord& f_r) const { return memcmp(Bytes, f_r.Bytes, KeySize) < 0; }
+};
+
+// ====================================
+// Complete positional I/O; false with errno set on errors
+static bool io_pread(int f_fd, void* f_buf, size_t f_n, uint64_t f_off)
+{
+	for(char* p = (char*)f_buf; f_n;)
+	{
+		ssize_t r = pread(f_fd, p, f_n, (off_t)f_off);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r <= 0)
+		{
+			if(!r)
+				errno = EIO;
+			return false;
+		}
+		p += r;
+		f_n -= r;
+		f_off += r;
+	}
+	return true;
+}
+
+static bool io_pwrite(int f_fd, const void* f_buf, size_t f_n, uint64_t f_off)
+{
+	for(const char* p = (const char*)f_buf; f_n;)
+	{
+		ssize_t r = pwrite(f_fd, p, f_n, (off_t)f_off);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r < 0)
+			return false;
+		p += r;
+		f_n -= r;
+		f_off += r;
+	}
+	return true;
+}
+
+// ====================================
+// Sequential reader of the records of a file: while the current block is
+// consumed, the next one is being read in the background
+template<class Record>
+class CExtReader
+{
+public:
+	CExtReader(): m_fd(-1), m_pos(0), m_end(0), m_i(0), m_n(0), m_ok(true) {}
+
+	// Records [f_first, f_first + f_records) of the file
+	void open(int f_fd, uint64_t f_first, uint64_t f_records, size_t f_block)
+	{
+		m_fd = f_fd;
+		m_pos = f_first;
+		m_end = f_first + f_records;
+		for(unsigned b = 0; b < 2; b++)
+			m_buf[b].resize(std::max<size_t>(1, std::min<uint64_t>(f_block, f_records)));
+		fetch();
+		next_block();
+	}
+
+	// NULL when the records are over (or on errors)
+	const Record* head() const { return (m_i < m_n) ? &m_buf[0][m_i] : NULL; }
+	bool ok() const { return m_ok; }
+
+	const Record* next()
+	{
+		if(++m_i == m_n)
+			next_block();
+		return head();
+	}
+
+private:
+	void fetch()
+	{
+		size_t n = (size_t)std::min<uint64_t>(m_buf[1].size(), m_end - m_pos);
+		Record* buf = &m_buf[1][0];
+		int fd = m_fd;
+		uint64_t off = m_pos * sizeof(Record);
+		m_pos += n;
+		m_pending = std::async(std::launch::async, [=]() { return io_pread(fd, buf, n * sizeof(Record), off) ? n : (size_t)-1; });
+	}
+
+	void next_block()
+	{
+		m_i = 0;
+		m_n = 0;
+		if(!m_pending.valid())
+			return;
+		size_t n = m_pending.get();
+		if(n == (size_t)-1)
+		{
+			m_ok = false;
+			return;
+		}
+		m_buf[0].swap(m_buf[1]);
+		m_n = n;
+		if(m_pos < m_end)
+			fetch();
+	}
+
+private:
+	int m_fd;
+	uint64_t m_pos;
+	uint64_t m_end;
+	std::vector<Record> m_buf[2];
+	size_t m_i;
+	size_t m_n;
+	std::future<size_t> m_pending;
+	bool m_ok;
+};
+
+// Sequential writer from the record f_first on: a full block is written
+// in the background while the next one is being filled
+template<class Record>
+class CExtWriter
+{
+public:
+	CExtWriter(int f_fd, size_t f_block, uint64_t f_first = 0):
+		m_fd(f_fd), m_pos(f_first * sizeof(Record)), m_n(0), m_ok(true)
+	{
+		for(unsigned b = 0; b < 2; b++)
+			m_buf[b].resize(std::max<size_t>(1, f_block));
+	}
+
+	void push(const Record& f_r)
+	{
+		m_buf[0][m_n] = f_r;
+		if(++m_n == m_buf[0].size())
+			flush();
+	}
+
+	// Write everything out; false on errors
+	bool finish()
+	{
+		flush();
+		wait();
+		return m_ok;
+	}
+
+private:
+	void wait()
+	{
+		if(m_pending.valid() && !m_pending.get())
+			m_ok = false;
+	}
+
+	void flush()
+	{
+		wait();
+		if(!m_n)
+			return;
+		m_buf[0].swap(m_buf[1]);
+		const Record* buf = &m_buf[1][0];
+		int fd = m_fd;
+		size_t bytes = m_n * sizeof(Record);
+		uint64_t off = m_pos;
+		m_pos += bytes;
+		m_n = 0;
+		m_pending = std::async(std::launch::async, [=]() { return io_pwrite(fd, buf, bytes, off); });
+	}
+
+private:
+	int m_fd;
+	uint64_t m_pos;
+	std::vector<Record> m_buf[2];
+	size_t m_n;
+	std::future<bool> m_pending;
+	bool m_ok;
+};
+
+// ============================================================================
+// External Merge Sort of a binary file of fixed-size records
+//
+// 1. Runs: the input is read in chunks of half the memory budget, the next
+//    chunk is read while the current one is sorted in place
+//    (sort_quick_parallel on the task pool: no scratch beyond the two
+//    chunks) and appended to a temporary file;
+// 2. merge: up to fan-in runs at a time go through a loser tree; every run
+//    and the output have two I/O blocks, so reads, the merge and writes
+//    overlap. The fan-in is what the budget allows: with too many runs
+//    the merge takes several passes, each writing longer runs to a new
+//    temporary file.
+// The budget covers the records: the two chunks while forming the runs,
+// the I/O blocks while merging. The small per-run and per-task overheads
+// (the run list, the loser tree, the stacks) are not counted.
+// The temporary files are unlinked right after creation.
+template<class Record>
+class CExternalSort
+{
+public:
+	struct Config
+	{
+		Config(): Memory(256 << 20), Block(1 << 20), Threads(hw_threads()), TempDir("/tmp") {}
+
+		size_t Memory;		// bytes of records in memory at once (chunks or blocks)
+		size_t Block;		// bytes per read/write request
+		unsigned Threads;
+		std::string TempDir;
+	};
+
+public:
+	CExternalSort(const Config& f_cfg = Config()): m_cfg(f_cfg), m_runs(0), m_passes(0) {}
+
+	// Sort f_in into f_out (may be the same file); false with errno set on errors
+	bool sort(const char* f_in, const char* f_out)
+	{
+		m_runs = m_passes = 0;
+
+		int in = ::open(f_in, O_RDONLY);
+		if(in < 0)
+			return false;
+		struct stat st;
+		bool bad = (fstat(in, &st) != 0);
+		if(!bad && st.st_size % sizeof(Record))
+		{
+			errno = EINVAL;
+			bad = true;
+		}
+		if(bad)
+		{
+			::close(in);
+			return false;
+		}
+
+		std::vector<Run> runs;
+		int tmp = temp_file();
+		bool ok = (tmp >= 0) && form_runs(in, st.st_size / sizeof(Record), tmp, runs);
+		::close(in);
+
+		// Merge down to the fan-in (two blocks per run and two for the output),
+		// then into the output
+		size_t blocks = m_cfg.Memory / block_bytes();
+		size_t fanin = (blocks >= 6) ? blocks / 2 - 1 : 2;
+		while(ok && runs.size() > fanin)
+		{
+			int next_tmp = temp_file();
+			std::vector<Run> next;
+			for(size_t i = 0; ok && next_tmp >= 0 && i < runs.size(); i += fanin)
+			{
+				size_t k = std::min(fanin, runs.size() - i);
+				Run r = { runs[i].First, 0 };
+				for(size_t j = i; j < i + k; j++)
+					r.Records += runs[j].Records;
+				ok = merge(tmp, &runs[i], k, next_tmp, r.First);
+				next.push_back(r);
+			}
+			ok = ok && (next_tmp >= 0);
+			::close(tmp);
+			tmp = next_tmp;
+			runs.swap(next);
+			m_passes++;
+		}
+
+		if(ok)
+		{
+			int out = ::open(f_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			ok = (out >= 0) && merge(tmp, runs.empty() ? NULL : &runs[0], runs.size(), out, 0);
+			if(out >= 0 && ::close(out))
+				ok = false;
+			m_passes++;
+		}
+		if(tmp >= 0)
+			::close(tmp);
+		return ok;
+	}
+
+	// Statistics of the last sort
+	unsigned runs() const { return m_runs; }
+	unsigned passes() const { return m_passes; }
+
+private:
+	// Records [First, First + Records) of the temporary file
+	struct Run
+	{
+		uint64_t First;
+		uint64_t Records;
+	};
+
+	size_t block_bytes() const { return std::max(m_cfg.Block, sizeof(Record)); }
+
+	int temp_file() const
+	{
+		std::string name = m_cfg.TempDir + "/extsort.XXXXXX";
+		int fd = mkstemp(&name[0]);
+		if(fd >= 0)
+			unlink(name.c_str());
+		return fd;
+	}
+
+	bool form_runs(int f_in, uint64_t f_n, int f_tmp, std::vector<Run>& f_runs)
+	{
+		size_t chunk = (size_t)std::min<uint64_t>(f_n, std::max<size_t>(1, m_cfg.Memory / 2 / sizeof(Record)));
+		if(!f_n)
+			return true;
+
+		CTaskPool pool(m_cfg.Threads);
+		std::vector<Record> buf[2];
+		buf[0].resize(chunk);
+		buf[1].resize(chunk);
+
+		uint64_t pos = 0;
+		size_t n = chunk;
+		if(!io_pread(f_in, &buf[0][0], n * sizeof(Record), 0))
+			return false;
+		for(pos = n; n; pos += n)
+		{
+			// Read the next chunk while this one is sorted and written
+			size_t next = (size_t)std::min<uint64_t>(chunk, f_n - pos);
+			Record* dst = &buf[1][0];
+			std::future<bool> read = std::async(std::launch::async, [=]()
+			{
+				return !next || io_pread(f_in, dst, next * sizeof(Record), pos * sizeof(Record));
+			});
+
+			sort_quick_parallel(&buf[0][0], n, pool);
+			Run r = { pos - n, n };
+			f_runs.push_back(r);
+			m_runs++;
+			bool ok = io_pwrite(f_tmp, &buf[0][0], n * sizeof(Record), r.First * sizeof(Record));
+
+			if(!read.get() || !ok)
+				return false;
+			buf[0].swap(buf[1]);
+			n = next;
+		}
+		return true;
+	}
+
+	// Merge the runs of f_in to f_out from the record f_first on
+	bool merge(int f_in, const Run* f_runs, size_t f_k, int f_out, uint64_t f_first)
+	{
+		size_t block = block_bytes() / sizeof(Record);
+		CExtWriter<Record> out(f_out, block, f_first);
+
+		std::vector< CExtReader<Record> > in(f_k);
+		for(size_t i = 0; i < f_k; i++)
+			in[i].open(f_in, f_runs[i].First, f_runs[i].Records, block);
+		merge_sources(in.empty() ? NULL : &in[0], f_k, [&out](const Record& r) { out.push(r); }, std::less<Record>());
+
+		bool ok = out.finish();
+		for(size_t i = 0; i < f_k; i++)
+			ok = ok && in[i].ok();
+		return ok;
+	}
+
+private:
+	Config m_cfg;
+	unsigned m_runs;
+	unsigned m_passes;
+};
+
+#endif // __EXTSORT_H__
@@ -0,0 +1,173 @@
+#ifndef __ISORT_H__
+#define __ISORT_H__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <type_traits>
+
+#include "sort.h"
+#include "radix.h"
+
+
+// ====================================
+// Indirect (key-index) Sort
+//
+// Large items are not moved while sorting: (key, index) pairs are sorted
+// instead - by the LSD radix sort when the key is arithmetic, by sort_pdq
+// otherwise - and the resulting permutation is applied at the end, moving
+// every item once: in place by following the cycles of the permutation,
+// or gathered to another buffer. Equal keys keep their input order (the
+// radix sort is stable, the comparison sort breaks ties by the index).
+template<class Key, class Index>
+struct KeyIndex
+{
+	Key K;
+	Index I;
+};
+
+template<class Key, class Index>
+static void sort_key_index(KeyIndex<Key, Index>* p, size_t n, unsigned threads, std::true_type)
+{
+	sort_radix_by(p, n, [](const KeyIndex<Key, Index>& x) { return x.K; }, threads);
+}
+
+template<class Key, class Index>
+static void sort_key_index(KeyIndex<Key, Index>* p, size_t n, unsigned, std::false_type)
+{
+	sort_pdq(p, n, [](const KeyIndex<Key, Index>& x, const KeyIndex<Key, Index>& y)
+	{
+		return (x.K < y.K) || (!(y.K < x.K) && x.I < y.I);
+	});
+}
+
+// The pairs of the keys of a[0, n) and their indices, sorted
+template<class Item, class KeyOf, class Key, class Index>
+static void sort_key_index_of(const Item* a, size_t n, KeyOf key, std::vector< KeyIndex<Key, Index> >& p, unsigned threads)
+{
+	p.resize(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		p[i].K = key(a[i]);
+		p[i].I = (Index)i;
+	}
+	if(n)
+		sort_key_index(&p[0], n, threads, std::is_arithmetic<Key>());
+}
+
+// perm[i] is the index in a of the i-th item of the sorted order
+template<class Item, class KeyOf, class Index>
+void sort_indices(const Item* a, size_t n, KeyOf key, Index* perm, unsigned threads = 1)
+{
+	typedef typename std::decay<decltype(key(*a))>::type Key;
+	std::vector< KeyIndex<Key, Index> > p;
+	sort_key_index_of(a, n, key, p, threads);
+	for(size_t i = 0; i < n; i++)
+		perm[i] = p[i].I;
+}
+
+// a[i] = a[perm[i]] for all i at once: every cycle of the permutation is
+// rotated through a single temporary
+template<class Item, class Index>
+void apply_permutation(Item* a, const Index* perm, size_t n)
+{
+	std::vector<bool> done(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		if(done[i] || (size_t)perm[i] == i)
+			continue;
+		Item tmp = std::move(a[i]);
+		size_t j = i;
+		for(size_t k; (k = (size_t)perm[j]) != i; j = k)
+		{
+			a[j] = std::move(a[k]);
+			done[j] = true;
+		}
+		a[j] = std::move(tmp);
+		done[j] = true;
+	}
+}
+
+// out[i] = a[perm[i]]; the reads go all over a, so the items a few steps
+// ahead are prefetched
+enum { GatherPrefetch = 8 };
+
+template<class Item, class Index>
+void gather_permutation(const Item* a, const Index* perm, size_t n, Item* out)
+{
+	for(size_t i = 0; i < n; i++)
+	{
+		if(i + GatherPrefetch < n)
+			__builtin_prefetch(&a[perm[i + GatherPrefetch]]);
+		out[i] = a[perm[i]];
+	}
+}
+
+// 32-bit indices unless there are too many items
+template<class Index, class Item, class KeyOf>
+static void sort_indirect_as(Item* a, size_t n, KeyOf key, unsigned threads)
+{
+	std::vector<Index> perm(n);
+	sort_indices(a, n, key, &perm[0], threads);
+	apply_permutation(a, &perm[0], n);
+}
+
+template<class Item, class KeyOf>
+void sort_indirect(Item* a, size_t n, KeyOf key, unsigned threads = 1)
+{
+	if(n < 2)
+		return;
+	if(n <= UINT32_MAX)
+		sort_indirect_as<uint32_t>(a, n, key, threads);
+	else
+		sort_indirect_as<size_t>(a, n, key, threads);
+}
+
+// The sorted items go to out, a stays as it is
+template<class Index, class Item, class KeyOf>
+static void sort_indirect_copy_as(const Item* a, size_t n, KeyOf key, Item* out, unsigned threads)
+{
+	std::vector<Index> perm(n);
+	sort_indices(a, n, key, &perm[0], threads);
+	gather_permutation(a, &perm[0], n, out);
+}
+
+template<class Item, class KeyOf>
+void sort_indirect_copy(const Item* a, size_t n, KeyOf key, Item* out, unsigned threads = 1)
+{
+	if(!n)
+		return;
+	if(n <= UINT32_MAX)
+		sort_indirect_copy_as<uint32_t>(a, n, key, out, threads);
+	else
+		sort_indirect_copy_as<size_t>(a, n, key, out, threads);
+}
+
+// Struct of arrays: the key column comes right out of the sorted pairs,
+// the value column follows the permutation
+template<class Index, class Key, class Value>
+static void sort_columns_as(Key* keys, Value* values, size_t n, unsigned threads)
+{
+	std::vector< KeyIndex<Key, Index> > p;
+	sort_key_index_of(keys, n, key_identity(), p, threads);
+	std::vector<Index> perm(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		keys[i] = p[i].K;
+		perm[i] = p[i].I;
+	}
+	apply_permutation(values, &perm[0], n);
+}
+
+template<class Key, class Value>
+void sort_columns(Key* keys, Value* values, size_t n, unsigned threads = 1)
+{
+	if(n < 2)
+		return;
+	if(n <= UINT32_MAX)
+		sort_columns_as<uint32_t>(keys, values, n, threads);
+	else
+		sort_columns_as<size_t>(keys, values, n, threads);
+}
+
+#endif // __ISORT_H__
@@ -0,0 +1,270 @@
+#ifndef __KMERGE_H__
+#define __KMERGE_H__
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+#include <cstddef>
+
+#include "parallel.h"
+
+
+// ====================================
+// Loser tree (tournament tree) over k sorted sources
+//
+// Every internal node keeps the loser of the match played there, the
+// winner goes up; node 0 keeps the overall winner. After the winner's
+// source moves on, only the matches on the path from its leaf to the root
+// are replayed: log2(k) comparisons, and unlike a heap no comparison of
+// the two children at every level. A source is given by the pointer to
+// its head item, NULL when it is exhausted; ties go to the lower source,
+// so merging runs of a stable sort in order stays stable.
+template<class Item, class Compare = std::less<Item> >
+class CLoserTree
+{
+public:
+	CLoserTree(unsigned f_k, Compare f_comp = Compare()):
+		m_k(f_k ? f_k : 1), m_tree(m_k), m_head(m_k, (const Item*)NULL), m_comp(f_comp)
+	{}
+
+	unsigned size() const { return m_k; }
+
+	// Set the heads of all the sources, then build()
+	void set(unsigned f_i, const Item* f_head) { m_head[f_i] = f_head; }
+	void build()
+	{
+		std::vector<Entry> win(m_k);
+		for(unsigned node = m_k - 1; node > 0; node--)
+		{
+			unsigned l = 2 * node, r = 2 * node + 1;
+			Entry a = (l < m_k) ? win[l] : leaf(l - m_k);
+			Entry b = (r < m_k) ? win[r] : leaf(r - m_k);
+			if(beats(b, a))
+				std::swap(a, b);
+			win[node] = a;
+			m_tree[node] = b;
+		}
+		m_tree[0] = (m_k > 1) ? win[1] : leaf(0);
+	}
+
+	// The source of the smallest head; its head is NULL when all are exhausted
+	unsigned winner() const { return m_tree[0].Src; }
+	const Item* top() const { return m_tree[0].Head; }
+
+	// The winner moved on to f_head (NULL: exhausted)
+	void replay(const Item* f_head)
+	{
+		Entry w = { f_head, m_tree[0].Src };
+		for(unsigned node = (w.Src + m_k) / 2; node > 0; node /= 2)
+		{
+			if(beats(m_tree[node], w))
+				std::swap(m_tree[node], w);
+		}
+		m_tree[0] = w;
+	}
+
+private:
+	// The nodes carry the heads along with the sources: one load less on
+	// the path of every replay
+	struct Entry
+	{
+		const Item* Head;
+		unsigned Src;
+	};
+
+	Entry leaf(unsigned f_i) const
+	{
+		Entry e = { m_head[f_i], f_i };
+		return e;
+	}
+
+	bool beats(const Entry& f_a, const Entry& f_b) const
+	{
+		if(!f_a.Head || !f_b.Head)
+			return !f_b.Head && (f_a.Head || f_a.Src < f_b.Src);
+		// One comparison: the lower source wins unless it is greater
+		return (f_a.Src < f_b.Src) ? !m_comp(*f_b.Head, *f_a.Head) : m_comp(*f_a.Head, *f_b.Head);
+	}
+
+private:
+	unsigned m_k;
+	std::vector<Entry> m_tree;
+	std::vector<const Item*> m_head;
+	Compare m_comp;
+};
+
+// ====================================
+// K-way Merge
+//
+// A source is anything with the interface of CExtReader: head() is the
+// pointer to the current item, NULL when the source is over, and next()
+// moves on and returns the new head. The loser tree keeps the heads of
+// all the sources, so a head must stay valid until its own source moves
+// on: file-backed runs (CExtReader) and ranges of input iterators that
+// return references into their own buffer (CRangeReader) both qualify.
+// The merged items go to sink(item) in order.
+template<class Source, class Sink, class Compare>
+void merge_sources(Source* in, size_t k, Sink sink, Compare comp)
+{
+	typedef typename std::decay<decltype(*in->head())>::type Item;
+	CLoserTree<Item, Compare> tree((unsigned)k, comp);
+	for(size_t i = 0; i < k; i++)
+		tree.set((unsigned)i, in[i].head());
+	tree.build();
+
+	for(const Item* r; (r = tree.top());)
+	{
+		sink(*r);
+		tree.replay(in[tree.winner()].next());
+	}
+}
+
+// Source over the items of [first, last)
+template<class Iter>
+class CRangeReader
+{
+public:
+	typedef typename std::iterator_traits<Iter>::value_type Item;
+
+public:
+	CRangeReader(): m_it(), m_end() {}
+	CRangeReader(Iter f_first, Iter f_last): m_it(f_first), m_end(f_last) {}
+
+	const Item* head() const { return (m_it != m_end) ? &*m_it : NULL; }
+	const Item* next()
+	{
+		++m_it;
+		return head();
+	}
+
+private:
+	Iter m_it;
+	Iter m_end;
+};
+
+// Merge the sorted runs [runs[i], runs[i] + n[i]) to out; equal items
+// keep the order of the runs
+template<class Item, class Out, class Compare = std::less<Item> >
+Out merge_kway(const Item* const* runs, const size_t* n, size_t k, Out out, Compare comp = Compare())
+{
+	std::vector< CRangeReader<const Item*> > in(k);
+	for(size_t i = 0; i < k; i++)
+		in[i] = CRangeReader<const Item*>(runs[i], runs[i] + n[i]);
+	merge_sources(in.empty() ? NULL : &in[0], k, [&out](const Item& x) { *out++ = x; }, comp);
+	return out;
+}
+
+// ====================================
+// Multi-sequence Selection: the positions pos[0, k) that cut the sorted
+// runs so that the prefixes [0, pos[i]) are exactly the first r items of
+// the stable merge.
+//
+// Every cut is kept within a range [lo, hi) of its run. The middle of the
+// widest range is the pivot; its rank among the items of all the ranges
+// (the items of the earlier runs that equal it go before it, those of the
+// later runs after it) tells whether the pivot is among the first r: if
+// so, all the cuts move up to the pivot's rank positions, otherwise down.
+// The widest range halves every step.
+template<class Item, class Compare>
+void multiway_select(const Item* const* runs, const size_t* n, size_t k, size_t r, size_t* pos, Compare comp)
+{
+	std::vector<size_t> lo(k, 0), hi(k);
+	for(size_t i = 0; i < k; i++)
+		hi[i] = std::min(n[i], r);
+
+	for(;;)
+	{
+		size_t j = k, width = 0;
+		for(size_t i = 0; i < k; i++)
+		{
+			if(hi[i] - lo[i] > width)
+			{
+				width = hi[i] - lo[i];
+				j = i;
+			}
+		}
+		if(j == k)
+			break;
+
+		size_t m = lo[j] + width / 2;
+		const Item& x = runs[j][m];
+		size_t c = 0;
+		for(size_t i = 0; i < k; i++)
+		{
+			const Item* b = runs[i] + lo[i];
+			const Item* e = runs[i] + hi[i];
+			if(i < j)
+				pos[i] = std::upper_bound(b, e, x, comp) - runs[i];
+			else if(i > j)
+				pos[i] = std::lower_bound(b, e, x, comp) - runs[i];
+			else
+				pos[i] = m;
+			c += pos[i];
+		}
+
+		if(c == r)
+			return;
+		if(c < r)
+		{
+			lo.assign(pos, pos + k);
+			lo[j] = m + 1;
+		}
+		else
+			hi.assign(pos, pos + k);
+	}
+	for(size_t i = 0; i < k; i++)
+		pos[i] = lo[i];
+}
+
+// ====================================
+// Parallel K-way Merge: the output is cut into a few pieces per thread by
+// multi-sequence selection, then every piece is merged from its own parts
+// of the runs by its own loser tree
+enum { KMergeGrain = 1 << 14 };
+
+template<class Item, class Compare = std::less<Item> >
+void merge_kway_parallel(const Item* const* runs, const size_t* n, size_t k, Item* out, CTaskPool& pool, Compare comp = Compare())
+{
+	size_t total = 0;
+	for(size_t i = 0; i < k; i++)
+		total += n[i];
+	unsigned pieces = (unsigned)std::max<size_t>(1, std::min<size_t>(pool.threads() * 4, total / KMergeGrain));
+	if(pieces < 2)
+	{
+		merge_kway(runs, n, k, out, comp);
+		return;
+	}
+
+	// cut[p * k + i]: the start of the piece p in the run i
+	std::vector<size_t> cut((pieces + 1) * k, 0);
+	std::copy(n, n + k, cut.begin() + pieces * k);
+	pool.run([&]()
+	{
+		for(unsigned p = 1; p < pieces; p++)
+		{
+			pool.spawn([&, p]() { multiway_select(runs, n, k, slice(total, pieces, p), &cut[p * k], comp); });
+		}
+	});
+
+	pool.run([&]()
+	{
+		for(unsigned p = 0; p < pieces; p++)
+		{
+			pool.spawn([&, p]()
+			{
+				std::vector<const Item*> part(k);
+				std::vector<size_t> len(k);
+				for(size_t i = 0; i < k; i++)
+				{
+					part[i] = runs[i] + cut[p * k + i];
+					len[i] = cut[(p + 1) * k + i] - cut[p * k + i];
+				}
+				merge_kway(&part[0], &len[0], k, out + slice(total, pieces, p), comp);
+			});
+		}
+	});
+}
+
+#endif // __KMERGE_H__
@@ -1,9 +1,23 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <functional>
 
 #include "sort.h"
 #include "search.h"
+#include "radix.h"
+#include "psort.h"
+#include "extsort.h"
+#include "select.h"
+#include "isort.h"
+#include "kmerge.h"
+#include "autosort.h"
 
 
 static unsigned urand()
@@ -44,6 +58,9 @@ static void check_sort(unsigned n)
 	//sort_quick3(&a[0], n);
 	sort_heap(&a[0], n);
 	//sort_merge(&a[0], n);
+	//sort_merge_stable(&a[0], n);
+	//sort_pdq(&a[0], n);
+	//sort_tim(&a[0], n);
 
 	c = clock() - c;
 
@@ -59,6 +76,674 @@ static void check_sort(unsigned n)
 				 " (" << c / (float)CLOCKS_PER_SEC << " sec (" << (c / n) << "))" << std::endl;
 }
 
+// ====================================
+// Floats holding both -0.0 and +0.0: the sorts must not change the bits,
+// and the stable ones must keep the order of the zeros
+static std::vector<unsigned> float_bits(const std::vector<float>& a, bool sorted)
+{
+	std::vector<unsigned> bits(a.size());
+	std::memcpy(&bits[0], &a[0], a.size() * sizeof(float));
+	if(sorted)
+		std::sort(bits.begin(), bits.end());
+	return bits;
+}
+
+template<class F>
+static void check_zeros(const char* name, const std::vector<float>& src, bool stable, F sort)
+{
+	std::vector<float> ref(src), a(src);
+	std::stable_sort(ref.begin(), ref.end());
+	sort(&a[0], a.size());
+	bool ok = stable ? (float_bits(a, false) == float_bits(ref, false)) :
+		(std::is_sorted(a.begin(), a.end()) && float_bits(a, true) == float_bits(ref, true));
+	std::cout << "  " << name << ": " << (ok ? "OK" : "FAILED!!!") << std::endl;
+}
+
+static void check_sort_zeros(unsigned n)
+{
+	std::vector<float> src(n);
+	for(unsigned i = 0; i < n; i++)
+	{
+		unsigned r = urand() >> 20;
+		src[i] = (r & 3) ? ((r & 4) ? -0.0f : 0.0f) : (float)((int)(r >> 3) - 256);
+	}
+
+	CTaskPool pool;
+	std::vector<float> buf(n);
+	std::cout << "Signed zeros (" << n << " floats):" << std::endl;
+	check_zeros("sort_merge_stable", src, true, [](float* p, size_t k) { sort_merge_stable(p, k); });
+	check_zeros("sort_merge_parallel", src, true, [&](float* p, size_t k) { sort_merge_parallel(p, k, pool, &buf[0]); });
+	check_zeros("sort_tim", src, true, [](float* p, size_t k) { sort_tim(p, k); });
+	check_zeros("sort_pdq", src, false, [](float* p, size_t k) { sort_pdq(p, k); });
+	check_zeros("sort_quick_parallel", src, false, [&pool](float* p, size_t k) { sort_quick_parallel(p, k, pool); });
+	check_zeros("sort_sample", src, false, [&pool](float* p, size_t k) { sort_sample(p, k, pool); });
+
+#ifdef SORT_SIMD_LANES
+	// The networks alone: the sorts above set the runs of equal pivots
+	// aside, so few zeros meet in their leaves
+	bool ok = true;
+	for(size_t i = 0, k = 2; i + k <= n; i += k, k = k % SimdNetworkMax + 1)
+	{
+		std::vector<float> ref(&src[i], &src[i] + k), a(ref);
+		sort_network(&a[0], k);
+		ok = ok && std::is_sorted(a.begin(), a.end()) && (float_bits(a, true) == float_bits(ref, true));
+	}
+	std::cout << "  sort_network: " << (ok ? "OK" : "FAILED!!!") << std::endl;
+#endif
+}
+
+// ====================================
+// Wall-clock time of a sort over a copy of the input
+template<class Item, class F>
+static double time_sort(const char* name, const std::vector<Item>& src, F sort)
+{
+	std::vector<Item> a(src);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	sort(&a[0], a.size());
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	std::cout << "  " << name << ": " << sec << " sec"
+			  << (is_sorted(&a[0], a.size()) ? "" : " FAILED!!!") << std::endl;
+	return sec;
+}
+
+static void bench_sort(unsigned n)
+{
+	std::vector<int> a(n);
+	irand(&a[0], n);
+	unsigned threads = hw_threads();
+
+	std::cout << "Sort benchmark (" << n << " ints, " << threads << " threads):" << std::endl;
+	time_sort("sort_quick", a, [](int* p, size_t k) { sort_quick(p, k); });
+	time_sort("sort_heap", a, [](int* p, size_t k) { sort_heap(p, k); });
+	time_sort("std::sort", a, [](int* p, size_t k) { std::sort(p, p + k); });
+	time_sort("sort_merge", a, [](int* p, size_t k) { sort_merge(p, k); });
+	std::vector<int> buf(n);
+	time_sort("sort_merge_stable", a, [&buf](int* p, size_t k) { sort_merge_stable(p, k, &buf[0]); });
+	CTaskPool pool(threads);
+	time_sort("sort_merge_parallel", a, [&](int* p, size_t k) { sort_merge_parallel(p, k, pool, &buf[0]); });
+	time_sort("sort_radix", a, [](int* p, size_t k) { sort_radix(p, k); });
+	time_sort("sort_radix (MT)", a, [threads](int* p, size_t k) { sort_radix(p, k, threads); });
+
+	// Floats of both signs and an extracted key
+	std::vector<float> f(n);
+	for(unsigned i = 0; i < n; i++)
+		f[i] = (float)a[i] / (1 << 20);
+	time_sort("sort_radix (float)", f, [threads](float* p, size_t k) { sort_radix(p, k, threads); });
+	time_sort("sort_radix_by (64-bit key)", a, [threads](int* p, size_t k)
+	{
+		sort_radix_by(p, k, [](const int& x) { return (long long)x; }, threads);
+	});
+}
+
+// sort_quick is O(n^2) on sorted and few-unique inputs: random only.
+// almost-sorted: 1% of random swaps; appended: a sorted log with 1% of new random items
+static void bench_pdq(unsigned n)
+{
+	const char* names[] = { "random", "sorted", "reversed", "few-unique", "almost-sorted", "appended" };
+	for(unsigned d = 0; d < sizeof(names) / sizeof(*names); d++)
+	{
+		std::vector<int> a(n);
+		irand(&a[0], n);
+		switch(d)
+		{
+			case 1: std::sort(a.begin(), a.end()); break;
+			case 2: std::sort(a.begin(), a.end()); std::reverse(a.begin(), a.end()); break;
+			case 3: for(unsigned i = 0; i < n; i++) a[i] &= 0xF; break;
+			case 4:
+				std::sort(a.begin(), a.end());
+				for(unsigned i = 0; i < n / 100; i++)
+					std::swap(a[urand() % n], a[urand() % n]);
+				break;
+			case 5: std::sort(a.begin(), a.end() - n / 100); break;
+		}
+
+		std::cout << "Sort benchmark (" << n << " ints, " << names[d] << "):" << std::endl;
+		if(!d)
+			time_sort("sort_quick", a, [](int* p, size_t k) { sort_quick(p, k); });
+		time_sort("sort_heap", a, [](int* p, size_t k) { sort_heap(p, k); });
+		time_sort("std::sort", a, [](int* p, size_t k) { std::sort(p, p + k); });
+		time_sort("sort_pdq", a, [](int* p, size_t k) { sort_pdq(p, k); });
+		time_sort("sort_merge_stable", a, [](int* p, size_t k) { sort_merge_stable(p, k); });
+		time_sort("sort_tim", a, [](int* p, size_t k) { sort_tim(p, k); });
+	}
+}
+
+// Binary top-down heap sort vs the d-ary bottom-up ones; past the caches
+// every level of the sift is a miss
+static void bench_heap(size_t n)
+{
+	std::vector<int> a(n);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)urand();
+
+	std::cout << "Heap sort benchmark (" << n << " ints):" << std::endl;
+	time_sort("sort_heap", a, [](int* p, size_t k) { sort_heap(p, k); });
+	time_sort("sort_heap_dary<2>", a, [](int* p, size_t k) { sort_heap_dary<2>(p, k); });
+	time_sort("sort_heap_dary<4>", a, [](int* p, size_t k) { sort_heap_dary<4>(p, k); });
+	time_sort("sort_heap_dary<8>", a, [](int* p, size_t k) { sort_heap_dary<8>(p, k); });
+	CTaskPool pool;
+	time_sort("sort_heap_parallel<2>", a, [&pool](int* p, size_t k) { sort_heap_parallel<2>(p, k, pool); });
+}
+
+#ifdef SORT_SIMD_LANES
+// Leaf kernels alone: many short ranges, insertion sort vs the sorting network.
+// Build with -mavx2 (or -msse4.1) to get the networks, with -DSORT_NO_SIMD
+// to time the full sorts without them.
+static void bench_leaf(unsigned n)
+{
+	std::vector<int> src(n);
+	irand(&src[0], n);
+
+	std::cout << "Leaf sort benchmark (" << n << " ints, " << SORT_SIMD_LANES << " lanes):" << std::endl;
+	for(unsigned k = 8; k <= SimdNetworkMax; k *= 2)
+	{
+		double sec[2];
+		bool ok = true;
+		for(unsigned alg = 0; alg < 2; alg++)
+		{
+			std::vector<int> a(src);
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			for(unsigned i = 0; i + k <= n; i += k)
+			{
+				if(alg)
+					sort_network(&a[i], k);
+				else
+					pdq_insertion(&a[i], &a[i] + k);
+			}
+			sec[alg] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			for(unsigned i = 0; i + k <= n; i += k)
+				ok = ok && is_sorted(&a[i], k);
+		}
+		std::cout << "  " << k << " items: insertion " << sec[0] * 1e9 / (n / k) << " ns, network "
+				  << sec[1] * 1e9 / (n / k) << " ns, speedup " << sec[0] / sec[1]
+				  << (ok ? "" : " FAILED!!!") << std::endl;
+	}
+}
+#endif
+
+// Strong scaling of the parallel sorts: the same input, 1..N threads
+static void bench_parallel(size_t n)
+{
+	std::vector<int> a(n);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)urand();
+
+	std::cout << "Parallel sort benchmark (" << n << " ints):" << std::endl;
+	double base = time_sort("sort_pdq", a, [](int* p, size_t k) { sort_pdq(p, k); });
+	for(unsigned t = 1, nt = hw_threads();; t = std::min(t * 2, nt))
+	{
+		CTaskPool pool(t);
+		std::cout << " " << t << " thread" << (t == 1 ? "" : "s") << ':' << std::endl;
+		double q = time_sort("sort_quick_parallel", a, [&pool](int* p, size_t k) { sort_quick_parallel(p, k, pool); });
+		double s = time_sort("sort_sample", a, [&pool](int* p, size_t k) { sort_sample(p, k, pool); });
+		std::cout << "  speedup: " << base / q << " / " << base / s << std::endl;
+		if(t == nt)
+			break;
+	}
+}
+
+// ====================================
+// Median and top-k without the full sort; the result is checked against the sorted input
+template<class F>
+static void time_select(const char* name, const std::vector<int>& src, const std::vector<int>& sorted, size_t k, F select)
+{
+	std::vector<int> a(src);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	select(&a[0], a.size(), k);
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	bool ok = true;
+	for(size_t i = 0; i < k && ok; i++)
+		ok = (a[i] == sorted[i]);
+	std::cout << "  " << name << ": " << sec << " sec" << (ok ? "" : " FAILED!!!") << std::endl;
+}
+
+static void bench_select(unsigned n, unsigned k)
+{
+	std::vector<int> a(n);
+	irand(&a[0], n);
+	std::vector<int> sorted(a);
+	sort_pdq(&sorted[0], n);
+
+	// The median only: check the item itself
+	std::cout << "Selection benchmark (" << n << " ints, median):" << std::endl;
+	size_t m = n / 2;
+	auto median = [&](const char* name, void (*select)(int*, size_t, size_t))
+	{
+		std::vector<int> b(a);
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		select(&b[0], n, m);
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		std::cout << "  " << name << ": " << sec << " sec" << ((b[m] == sorted[m]) ? "" : " FAILED!!!") << std::endl;
+	};
+	median("select_intro", select_intro<int>);
+	median("select_floyd_rivest", select_floyd_rivest<int>);
+	median("select_mom", [](int* p, size_t n, size_t k) { select_mom(p, n, k); });
+	median("std::nth_element", [](int* p, size_t n, size_t k) { std::nth_element(p, p + k, p + n); });
+
+	std::cout << "Top-k benchmark (" << n << " ints, k = " << k << "):" << std::endl;
+	time_select("sort_pdq", a, sorted, k, [](int* p, size_t n, size_t) { sort_pdq(p, n); });
+	time_select("sort_partial", a, sorted, k, [](int* p, size_t n, size_t k) { sort_partial(p, n, k); });
+	time_select("select_top", a, sorted, k, [](int* p, size_t n, size_t k)
+	{
+		std::vector<int> top(k);
+		select_top(p, n, k, &top[0]);
+		std::copy(top.begin(), top.end(), p);
+	});
+	time_select("std::partial_sort", a, sorted, k, [](int* p, size_t n, size_t k) { std::partial_sort(p, p + k, p + n); });
+}
+
+// ====================================
+// Direct vs indirect sort of records of growing size, the same count of
+// each: the direct sorts move whole records around, the indirect ones
+// sort 8-byte (key, index) pairs and move every record once
+template<unsigned Size>
+struct Record
+{
+	int Key;
+	char Payload[Size - sizeof(int)];
+
+	bool operator<(const Record& r) const { return Key < r.Key; }
+};
+
+template<unsigned Size>
+static void bench_indirect_record(size_t n)
+{
+	typedef Record<Size> R;
+	std::vector<R> a(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		a[i].Key = (int)urand();
+		memset(a[i].Payload, (int)i, sizeof(a[i].Payload));
+	}
+	auto key = [](const R& r) { return r.Key; };
+
+	std::cout << "Indirect sort benchmark (" << n << " records of " << Size << " bytes):" << std::endl;
+	time_sort("sort_pdq", a, [](R* p, size_t k) { sort_pdq(p, k); });
+	time_sort("sort_radix_by", a, [&](R* p, size_t k) { sort_radix_by(p, k, key); });
+	time_sort("sort_indirect", a, [&](R* p, size_t k) { sort_indirect(p, k, key); });
+	std::vector<R> out(n);
+	time_sort("sort_indirect_copy", a, [&](R* p, size_t k)
+	{
+		sort_indirect_copy(p, k, key, &out[0]);
+		std::swap_ranges(p, p + k, &out[0]);
+	});
+}
+
+static void bench_indirect(size_t n)
+{
+	bench_indirect_record<8>(n);
+	bench_indirect_record<16>(n);
+	bench_indirect_record<32>(n);
+	bench_indirect_record<64>(n);
+	bench_indirect_record<128>(n);
+	bench_indirect_record<256>(n);
+	bench_indirect_record<512>(n);
+
+	// Key and value columns
+	std::vector<int> keys(n);
+	irand(&keys[0], (unsigned)n);
+	std::vector<double> values(keys.begin(), keys.end());
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	sort_columns(&keys[0], &values[0], n);
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	bool ok = is_sorted(&keys[0], n);
+	for(size_t i = 0; ok && i < n; i++)
+		ok = (values[i] == keys[i]);
+	std::cout << "Column sort (" << n << " int keys, double values): " << (ok ? "OK" : "FAILED!!!")
+			  << " (" << sec << " sec)" << std::endl;
+}
+
+// ====================================
+// The choices of sort_auto on a few shapes of input, timed against sort_pdq
+template<class Item>
+static void time_auto(const char* name, const std::vector<Item>& src)
+{
+	std::vector<Item> a(src);
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	SortPlan plan = sort_auto(&a[0], a.size());
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	bool ok = is_sorted(&a[0], a.size());
+
+	a = src;
+	t0 = std::chrono::steady_clock::now();
+	sort_pdq(&a[0], a.size());
+	double pdq = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	std::cout << "  " << name << ": " << plan << ' ' << sec << " sec (sort_pdq " << pdq << " sec)"
+			  << (ok ? "" : " FAILED!!!") << std::endl;
+}
+
+static void bench_auto(size_t n, const char* path)
+{
+	// Calibrate on the first run, then reuse the thresholds
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	bool loaded = sort_auto_load(path);
+	if(!loaded)
+	{
+		sort_auto_calibrate();
+		sort_auto_save(path);
+	}
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	const SortAutoConfig& cfg = sort_auto_config();
+	std::cout << "Auto sort calibration (" << (loaded ? "loaded from " : "saved to ") << path << ", "
+			  << sec << " sec): radix from " << cfg.RadixMin
+			  << " items and " << cfg.RadixDistinct << " distinct, counting up to "
+			  << cfg.CountingRange << " values per item, tim below " << cfg.Presorted << " disorder" << std::endl;
+
+	std::cout << "Auto sort benchmark (" << n << " items):" << std::endl;
+	std::vector<int> a(n);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)urand();
+	time_auto("random", a);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)(urand() % 16);
+	time_auto("16 values", a);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)(urand() % n);
+	time_auto("range n", a);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)i;
+	time_auto("sorted", a);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (int)(n - i);
+	time_auto("reversed", a);
+	for(size_t i = 0; i < n / 1000; i++)
+		std::swap(a[urand() % n], a[urand() % n]);
+	time_auto("reversed, 0.1% swapped", a);
+
+	std::vector<double> d(n);
+	for(size_t i = 0; i < n; i++)
+		d[i] = urand() / 3.0 - 1e9;
+	time_auto("random doubles", d);
+
+	std::vector<std::string> s(n / 4);
+	for(size_t i = 0; i < s.size(); i++)
+		s[i] = std::to_string(urand());
+	time_auto("random strings", s);
+	sort_pdq(&s[0], s.size());
+	time_auto("sorted strings", s);
+}
+
+// ====================================
+// Records keyed by a status code from [100, 600): counting sorts against
+// the stable comparison and radix sorts
+struct StatusRecord
+{
+	uint16_t Status;
+	uint32_t Id;
+	char Pad[10];
+};
+
+static void bench_counting(size_t n)
+{
+	std::vector<StatusRecord> src(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		src[i].Status = (uint16_t)(100 + urand() % 500);
+		src[i].Id = (uint32_t)i;
+	}
+	auto status = [](const StatusRecord& r) { return r.Status; };
+	auto by_status = [](const StatusRecord& x, const StatusRecord& y) { return x.Status < y.Status; };
+	auto stable = [](const StatusRecord* a, size_t m)
+	{
+		for(size_t i = 1; i < m; i++)
+		{
+			if(a[i].Status < a[i - 1].Status || (a[i].Status == a[i - 1].Status && a[i].Id < a[i - 1].Id))
+				return false;
+		}
+		return true;
+	};
+	unsigned threads = hw_threads();
+
+	std::cout << "Counting sort benchmark (" << n << " records, 500 keys, " << threads << " threads):" << std::endl;
+	std::vector<StatusRecord> a;
+	auto run = [&](const char* name, bool need_stable, std::function<void(StatusRecord*, size_t)> sort)
+	{
+		a = src;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		sort(&a[0], n);
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		bool ok = need_stable ? stable(&a[0], n) : is_sorted(&a[0], n, by_status);
+		std::cout << "  " << name << ": " << sec << " sec" << (ok ? "" : " FAILED!!!") << std::endl;
+	};
+	run("std::stable_sort", true, [&](StatusRecord* p, size_t m) { std::stable_sort(p, p + m, by_status); });
+	run("sort_radix_by", true, [&](StatusRecord* p, size_t m) { sort_radix_by(p, m, status, threads); });
+	run("sort_counting_by (1 thread)", true, [&](StatusRecord* p, size_t m) { sort_counting_by(p, m, status, 100, 599); });
+	run("sort_counting_by", true, [&](StatusRecord* p, size_t m) { sort_counting_by(p, m, status, 100, 599, false, threads); });
+	run("sort_flag_by", false, [&](StatusRecord* p, size_t m) { sort_flag_by(p, m, status, 100, 599, false, threads); });
+
+	std::vector<StatusRecord> out(n);
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	sort_counting_copy_by(&src[0], n, status, 100, 599, &out[0], false, threads);
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::cout << "  sort_counting_copy_by: " << sec << " sec" << (stable(&out[0], n) ? "" : " FAILED!!!") << std::endl;
+}
+
+// ====================================
+// K-way merge of k sorted shards against sorting them all over again
+static void bench_kmerge(size_t n, size_t k)
+{
+	std::vector< std::vector<int> > shard(k);
+	std::vector<const int*> runs(k);
+	std::vector<size_t> len(k);
+	std::vector<int> all;
+	for(size_t i = 0; i < k; i++)
+	{
+		shard[i].resize(slice(n, (unsigned)k, (unsigned)i + 1) - slice(n, (unsigned)k, (unsigned)i));
+		for(size_t j = 0; j < shard[i].size(); j++)
+			shard[i][j] = (int)urand();
+		sort_pdq(shard[i].data(), shard[i].size());
+		runs[i] = shard[i].data();
+		len[i] = shard[i].size();
+		all.insert(all.end(), shard[i].begin(), shard[i].end());
+	}
+	std::vector<int> sorted(all);
+	sort_pdq(&sorted[0], n);
+
+	std::cout << "K-way merge benchmark (" << n << " ints, " << k << " runs):" << std::endl;
+	time_sort("sort_pdq", all, [](int* p, size_t m) { sort_pdq(p, m); });
+
+	std::vector<int> out(n);
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	merge_kway(&runs[0], &len[0], k, &out[0]);
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::cout << "  merge_kway: " << sec << " sec" << ((out == sorted) ? "" : " FAILED!!!") << std::endl;
+
+	CTaskPool pool;
+	std::fill(out.begin(), out.end(), 0);
+	t0 = std::chrono::steady_clock::now();
+	merge_kway_parallel(&runs[0], &len[0], k, &out[0], pool);
+	sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::cout << "  merge_kway_parallel (" << pool.threads() << " threads): " << sec << " sec"
+			  << ((out == sorted) ? "" : " FAILED!!!") << std::endl;
+}
+
+// ====================================
+// External sort of a file of 100-byte records (10-byte keys) with a memory
+// budget well below the file size
+static void bench_extsort(unsigned n, size_t memory)
+{
+	typedef ExtRecord<100, 10> Record;
+
+	// Unique names in the shared /tmp, created by us (the output is
+	// reopened by name)
+	char in[] = "/tmp/extsort.in.XXXXXX";
+	char out[] = "/tmp/extsort.out.XXXXXX";
+	int fd_in = mkstemp(in);
+	int fd_out = mkstemp(out);
+	FILE* f = (fd_in >= 0) ? fdopen(fd_in, "wb") : NULL;
+	if(fd_out >= 0)
+		close(fd_out);
+	if(!f || fd_out < 0)
+	{
+		std::cout << "External sort: can't create the files in /tmp" << std::endl;
+		if(f)
+			fclose(f);
+		else if(fd_in >= 0)
+			close(fd_in);
+		if(fd_in >= 0)
+			remove(in);
+		if(fd_out >= 0)
+			remove(out);
+		return;
+	}
+	Record r;
+	for(unsigned i = 0; i < n; i++)
+	{
+		for(unsigned j = 0; j < sizeof(r.Bytes); j += sizeof(unsigned))
+		{
+			unsigned u = urand();
+			memcpy(r.Bytes + j, &u, sizeof(u));
+		}
+		fwrite(&r, sizeof(r), 1, f);
+	}
+	fclose(f);
+
+	CExternalSort<Record>::Config cfg;
+	cfg.Memory = memory;
+	CExternalSort<Record> sorter(cfg);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	bool ok = sorter.sort(in, out);
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	// Check the order and the count
+	unsigned count = 0;
+	Record prev;
+	f = fopen(out, "rb");
+	for(; ok && f && fread(&r, sizeof(r), 1, f) == 1; count++, prev = r)
+		ok = !count || !(r < prev);
+	if(f)
+		fclose(f);
+	remove(in);
+	remove(out);
+
+	std::cout << "External sort (" << n << " records, " << (memory >> 20) << " MB): "
+			  << ((ok && count == n) ? "OK" : "FAILED!!!") << " (" << sec << " sec, "
+			  << sorter.runs() << " runs, " << sorter.passes() << " passes)" << std::endl;
+}
+
+// ====================================
+// Lookups of random keys in sorted arrays from the L1 size up: ns per lookup
+// (the results go to the sink so that the lookups are not optimized away)
+static volatile size_t search_sink;
+
+template<class F>
+static void time_search(const char* name, const std::vector<int>& keys, F find)
+{
+	size_t sum = 0;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < keys.size(); i++)
+		sum += find(keys[i]);
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	search_sink = sum;
+	std::cout << ' ' << name << ' ' << sec * 1e9 / keys.size();
+}
+
+static void bench_search(size_t max_n)
+{
+	std::vector<int> keys(1 << 20);
+	irand(&keys[0], (unsigned)keys.size());
+
+	std::cout << "Search benchmark (ns per lookup):" << std::endl;
+	for(size_t n = 1 << 10; n <= max_n; n *= 8)
+	{
+		std::vector<int> a(n);
+		for(size_t i = 0; i < n; i++)
+			a[i] = (int)urand();
+		sort_radix(&a[0], n);
+		CEytzinger<int, int> eyt(&a[0], n);
+		CSimdTree<int, int> tree(&a[0], n);
+
+		std::cout << "  " << (n * sizeof(int) >> 10) << " KB:";
+		time_search("find_binary", keys, [&](int k) { return find_binary(k, &a[0], (unsigned)n) != NULL; });
+		time_search("std::lower_bound", keys, [&](int k) { return (size_t)(std::lower_bound(a.begin(), a.end(), k) - a.begin()); });
+		time_search("lower_bound_branchless", keys, [&](int k) { return lower_bound_branchless(k, &a[0], n); });
+		time_search("CEytzinger", keys, [&](int k) { return eyt.lower_bound(k); });
+		time_search("CSimdTree", keys, [&](int k) { return tree.lower_bound(k); });
+		std::cout << std::endl;
+	}
+}
+
+// ====================================
+// The learned index against the binary and the Eytzinger search on uniform
+// and skewed keys: ns per lookup and the memory of the index
+static void bench_learned(size_t n)
+{
+	std::vector<int> keys(1 << 20);
+	irand(&keys[0], (unsigned)keys.size());
+	std::vector<int> a(n);
+
+	std::cout << "Learned index benchmark (" << n << " ints, ns per lookup / index MB):" << std::endl;
+	for(unsigned skewed = 0; skewed < 2; skewed++)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			// Skewed: the cube of a uniform number in [0, 1), stretched over the ints
+			double u = urand() / 4294967296.0;
+			a[i] = skewed ? (int)(u * u * u * 4e9 - 2e9) : (int)urand();
+		}
+		sort_radix(&a[0], n);
+		CEytzinger<int, int> eyt(&a[0], n);
+		CLearnedIndex<int, int> learned(&a[0], n);
+
+		double mb = 1.0 / (1 << 20);
+		std::cout << "  " << (skewed ? "skewed" : "uniform") << ':';
+		time_search("find_binary", keys, [&](int k) { return find_binary(k, &a[0], (unsigned)n) != NULL; });
+		std::cout << " / 0";
+		time_search("CEytzinger", keys, [&](int k) { return eyt.lower_bound(k); });
+		std::cout << " / " << n * (sizeof(int) + sizeof(uint32_t)) * mb;
+		time_search("CLearnedIndex", keys, [&](int k) { return learned.lower_bound(k); });
+		std::cout << " / " << learned.memory() * mb << " (" << learned.segments() << " segments)" << std::endl;
+	}
+}
+
+// ====================================
+// Batched lookups against the one-at-a-time loop: million lookups per second
+template<class F>
+static void time_batch(const char* name, size_t m, F find)
+{
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	find();
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	std::cout << ' ' << name << ' ' << m / sec / 1e6;
+}
+
+static void bench_search_batch(size_t max_n)
+{
+	std::vector<int> keys(1 << 20);
+	irand(&keys[0], (unsigned)keys.size());
+	size_t m = keys.size();
+	std::vector<int*> out(m);
+	std::vector<const int*> found(m);
+
+	std::cout << "Batched search benchmark (M lookups/sec, one at a time / batched):" << std::endl;
+	for(size_t n = 1 << 12; n <= max_n; n *= 8)
+	{
+		// The tree points to the items: it gets a copy of its own
+		std::vector<int> a(n);
+		for(size_t i = 0; i < n; i++)
+			a[i] = (int)urand();
+		std::vector<int> items(a);
+		BST<int, int> bst(&items[0], (unsigned)n);
+		sort_radix(&a[0], n);
+		CEytzinger<int, int> eyt(&a[0], n);
+
+		std::cout << "  " << n << " items:";
+		time_batch("find_binary", m, [&]() { for(size_t i = 0; i < m; i++) out[i] = find_binary(keys[i], &a[0], (unsigned)n); });
+		time_batch("/", m, [&]() { find_many(&keys[0], m, &a[0], (unsigned)n, &out[0]); });
+		time_batch(" CEytzinger", m, [&]() { for(size_t i = 0; i < m; i++) found[i] = eyt.find(keys[i]); });
+		time_batch("/", m, [&]() { eyt.find_many(&keys[0], m, &found[0]); });
+		time_batch(" BST", m, [&]() { for(size_t i = 0; i < m; i++) out[i] = bst.find(keys[i]); });
+		time_batch("/", m, [&]() { bst.find_many(&keys[0], m, &out[0]); });
+		std::cout << std::endl;
+	}
+}
+
 // ====================================
 static void check_search(unsigned n)
 {
@@ -105,12 +790,258 @@ static void check_search(unsigned n)
 }
 
 // ====================================
-int main(int, char**)
+// The search indexes against std::lower_bound: the lower bound and the
+// first hit of every item, its neighbours and the extreme keys. The sizes
+// are around the node and level boundaries of CSimdTree (16 keys, 17
+// children); the items are random or runs of a few values with INT_MIN
+// and INT_MAX among them.
+template<class L, class F>
+static void check_index(bool& ok, const std::vector<int>& a, const std::vector<int>& keys, L lower_bound, F find)
+{
+	for(size_t i = 0; i < keys.size(); i++)
+	{
+		size_t lb = std::lower_bound(a.begin(), a.end(), keys[i]) - a.begin();
+		const int* hit = (lb < a.size() && a[lb] == keys[i]) ? &a[lb] : NULL;
+		ok = ok && (lower_bound(keys[i]) == lb) && (find(keys[i]) == hit);
+	}
+}
+
+static void check_search_index()
+{
+	const size_t sizes[] = { 1, 2, 16, 17, 288, 289, 4913 };
+	const int values[] = { INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX, INT_MAX };
+	bool ok[3] = { true, true, true };
+
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+	{
+		for(unsigned dup = 0; dup < 2; dup++)
+		{
+			size_t n = sizes[s];
+			std::vector<int> a(n);
+			for(size_t i = 0; i < n; i++)
+				a[i] = dup ? values[urand() >> 29] : (int)urand();
+			std::sort(a.begin(), a.end());
+
+			std::vector<int> keys;
+			keys.push_back(INT_MIN);
+			keys.push_back(INT_MAX);
+			for(size_t i = 0; i < n; i++)
+			{
+				keys.push_back(a[i]);
+				if(a[i] > INT_MIN)
+					keys.push_back(a[i] - 1);
+				if(a[i] < INT_MAX)
+					keys.push_back(a[i] + 1);
+			}
+
+			CEytzinger<int, int> eyt(&a[0], n);
+			CSimdTree<int, int> tree(&a[0], n);
+			check_index(ok[0], a, keys, [&](int k) { return lower_bound_branchless(k, &a[0], n); },
+				[&](int k) { return find_binary(k, &a[0], (unsigned)n); });
+			check_index(ok[1], a, keys, [&](int k) { return eyt.lower_bound(k); }, [&](int k) { return eyt.find(k); });
+			check_index(ok[2], a, keys, [&](int k) { return tree.lower_bound(k); }, [&](int k) { return tree.find(k); });
+		}
+	}
+
+	const char* names[] = { "lower_bound_branchless", "CEytzinger", "CSimdTree" };
+	for(unsigned i = 0; i < 3; i++)
+		std::cout << "Search index (" << names[i] << "): " << (ok[i] ? "OK" : "FAILED!!!") << std::endl;
+}
+
+// ====================================
+// CSimdTree over every shape of the padded tails: up to three levels of
+// nodes (17^3 = 4913 items), the last node of every level padded with
+// INT_MAX. The items end with a run of INT_MAX, equal to the pad; the
+// queries are the items of the last nodes, their neighbours and the
+// extreme keys.
+static bool check_tree(size_t n)
+{
+	std::vector<int> a(n);
+	for(size_t i = 0; i < n; i++)
+		a[i] = (i + n % 7 >= n) ? INT_MAX : (int)(urand() >> 1);
+	std::sort(a.begin(), a.end());
+	CSimdTree<int, int> tree(&a[0], n);
+
+	std::vector<int> keys;
+	keys.push_back(INT_MIN);
+	keys.push_back(INT_MAX);
+	keys.push_back(INT_MAX - 1);
+	for(size_t i = (n > 40) ? n - 40 : 0; i < n; i++)
+	{
+		keys.push_back(a[i]);
+		keys.push_back(a[i] - 1);
+		if(a[i] < INT_MAX)
+			keys.push_back(a[i] + 1);
+	}
+
+	bool ok = true;
+	check_index(ok, a, keys, [&](int k) { return tree.lower_bound(k); }, [&](int k) { return tree.find(k); });
+	return ok;
+}
+
+static void check_search_tree()
+{
+	bool ok = true;
+	for(size_t n = 1; n <= 5000; n += (n < 600 || (n > 4860 && n < 4960)) ? 1 : 97)
+		ok = ok && check_tree(n);
+	std::cout << "Search index (CSimdTree tails): " << (ok ? "OK" : "FAILED!!!") << std::endl;
+}
+
+// ====================================
+// CLearnedIndex with the tightest bounds (Eps 0 and 1): uniform items with
+// INT_MIN and INT_MAX, runs of duplicates (their ends are the extra points
+// (key + 1, end), sometimes the next key itself), skewed items, and a few
+// long runs. The queries are the items, their neighbours and the middles
+// of the gaps, which fall between the segments as well.
+static void check_search_learned()
+{
+	const size_t sizes[] = { 1, 2, 3, 17, 5000 };
+	const char* names[] = { "uniform", "duplicates", "skewed", "long runs" };
+	bool ok[4] = { true, true, true, true };
+
+	for(unsigned d = 0; d < 4; d++)
+	{
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+		{
+			size_t n = sizes[s];
+			std::vector<int> a(n);
+			int v = -1000;
+			for(size_t i = 0; i < n; i++)
+			{
+				double u = urand() / 4294967296.0;
+				switch(d)
+				{
+					case 0: a[i] = (int)urand(); break;
+					case 1:
+						if(!(urand() >> 30))
+							v += 1 + (urand() >> 28);
+						a[i] = v;
+						break;
+					case 2: a[i] = (int)(u * u * u * 4e9 - 2e9); break;
+					case 3: a[i] = (int)(urand() >> 30) * 1000; break;
+				}
+			}
+			if(!d && n > 2)
+			{
+				a[0] = INT_MIN;
+				a[1] = INT_MAX;
+			}
+			std::sort(a.begin(), a.end());
+
+			std::vector<int> keys;
+			keys.push_back(INT_MIN);
+			keys.push_back(INT_MAX);
+			for(size_t i = 0; i < n; i++)
+			{
+				keys.push_back(a[i]);
+				if(a[i] > INT_MIN)
+					keys.push_back(a[i] - 1);
+				if(a[i] < INT_MAX)
+					keys.push_back(a[i] + 1);
+				if(i + 1 < n)
+					keys.push_back((int)(((long long)a[i] + a[i + 1]) / 2));
+			}
+
+			for(size_t eps = 0; eps < 2; eps++)
+			{
+				CLearnedIndex<int, int> learned(&a[0], n, eps);
+				check_index(ok[d], a, keys, [&](int k) { return learned.lower_bound(k); }, [&](int k) { return learned.find(k); });
+			}
+		}
+	}
+
+	for(unsigned d = 0; d < 4; d++)
+		std::cout << "Search index (CLearnedIndex, " << names[d] << "): " << (ok[d] ? "OK" : "FAILED!!!") << std::endl;
+}
+
+// ====================================
+// The batched lookups against the one at a time ones: a batch which ends
+// with a partial group, Eytzinger trees with a full (15, 4095) and a partial
+// last level, and duplicate items (the BST hands its group slots over to
+// the next keys as the searches end at different depths)
+static void check_search_batch()
+{
+	const size_t sizes[] = { 1, 15, 16, 17, 1000, 4095, 4096 };
+	bool ok[3] = { true, true, true };
+
+	for(size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+	{
+		for(unsigned dup = 0; dup < 2; dup++)
+		{
+			// The tree points to the items: it gets a copy of its own
+			size_t n = sizes[s];
+			std::vector<int> a(n);
+			for(size_t i = 0; i < n; i++)
+				a[i] = dup ? (int)(urand() >> 26) : (int)urand();
+			std::vector<int> items(a);
+			BST<int, int> bst(&items[0], (unsigned)n);
+			std::sort(a.begin(), a.end());
+			CEytzinger<int, int> eyt(&a[0], n);
+
+			// Hits and misses
+			std::vector<int> keys(1003);
+			for(size_t i = 0; i < keys.size(); i++)
+				keys[i] = (i & 1) ? a[(urand() >> 8) % n] : dup ? (int)(urand() >> 26) : (int)urand();
+			keys[0] = INT_MIN;
+			keys[2] = INT_MAX;
+			size_t m = keys.size();
+			std::vector<int*> out(m);
+			std::vector<const int*> found(m);
+
+			find_many(&keys[0], m, &a[0], (unsigned)n, &out[0]);
+			for(size_t i = 0; i < m; i++)
+				ok[0] = ok[0] && (out[i] == find_binary(keys[i], &a[0], (unsigned)n));
+			eyt.find_many(&keys[0], m, &found[0]);
+			for(size_t i = 0; i < m; i++)
+				ok[1] = ok[1] && (found[i] == eyt.find(keys[i]));
+			bst.find_many(&keys[0], m, &out[0]);
+			for(size_t i = 0; i < m; i++)
+				ok[2] = ok[2] && (out[i] == bst.find(keys[i]));
+		}
+	}
+
+	const char* names[] = { "find_many", "CEytzinger::find_many", "BST::find_many" };
+	for(unsigned i = 0; i < 3; i++)
+		std::cout << "Batched search (" << names[i] << "): " << (ok[i] ? "OK" : "FAILED!!!") << std::endl;
+}
+
+// ====================================
+// The checks; "bench [n [cfg]]" runs the benchmarks after them, n is the
+// item count for the parallel sort benchmark, cfg the calibration file of
+// sort_auto (sort_auto.cfg in the current directory)
+int main(int argc, char** argv)
 {
 	const unsigned N = 1024 * 1024 - 1;
 
 	check_sort(N);
+	check_sort_zeros(1 << 18);
 	check_search(N);
+	check_search_index();
+	check_search_tree();
+	check_search_learned();
+	check_search_batch();
+	if(argc < 2 || strcmp(argv[1], "bench"))
+		return 0;
+
+	bench_search(1 << 28);
+	bench_search_batch(1 << 24);
+	bench_learned(1 << 26);
+	bench_sort(N);
+	bench_pdq(N);
+	bench_heap(N);
+	bench_heap(16 << 20);
+#ifdef SORT_SIMD_LANES
+	bench_leaf(N);
+#endif
+	bench_select(16 << 20, 100);
+	bench_indirect(1 << 18);
+	bench_auto(N, (argc > 3) ? argv[3] : "sort_auto.cfg");
+	bench_counting(16 << 20);
+	bench_kmerge(16 << 20, 4);
+	bench_kmerge(16 << 20, 64);
+	bench_kmerge(16 << 20, 1024);
+	bench_extsort(1 << 20, 16 << 20);
+	bench_parallel((argc > 2) ? strtoull(argv[2], NULL, 10) : (16 << 20));
 
 	return 0;
 }
@@ -0,0 +1,202 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstddef>
+
+
+static unsigned hw_threads()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+// The start of the slice t of [0, n) split into `threads` nearly equal slices
+static size_t slice(size_t n, unsigned threads, unsigned t)
+{
+	return n / threads * t + n % threads * t / threads;
+}
+
+// Split [0, n) into `threads` contiguous slices and run
+// fn(thread, begin, end) for each of them in its own thread
+template<class F>
+void parallel_for(size_t n, unsigned threads, F fn)
+{
+	if(threads > n)
+		threads = n ? (unsigned)n : 1;
+	if(threads < 2)
+	{
+		fn(0u, (size_t)0, n);
+		return;
+	}
+
+	std::vector<std::thread> pool;
+	for(unsigned t = 1; t < threads; t++)
+		pool.push_back(std::thread(fn, t, slice(n, threads, t), slice(n, threads, t + 1)));
+	fn(0u, (size_t)0, slice(n, threads, 1));
+	for(unsigned t = 0; t < pool.size(); t++)
+		pool[t].join();
+}
+
+// ====================================
+// Work-stealing thread pool
+//
+// Every thread owns a deque of tasks: it pushes and pops its own tasks at
+// the back (the most recent, cache-hot ones) and, when it runs out of work,
+// steals from the front of the others (the oldest, usually the largest).
+// The thread calling run() takes part in the work as thread 0.
+class CTaskPool
+{
+public:
+	typedef std::function<void()> task_t;
+
+public:
+	CTaskPool(unsigned threads = hw_threads()):
+		m_n(threads ? threads : 1),
+		m_queues(new Queue[m_n]),
+		m_queued(0),
+		m_pending(0),
+		m_stop(false)
+	{
+		for(unsigned i = 1; i < m_n; i++)
+			m_workers.push_back(std::thread(&CTaskPool::worker, this, i));
+	}
+	~CTaskPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_idle_lock);
+			m_stop = true;
+		}
+		m_idle.notify_all();
+		for(unsigned i = 0; i < m_workers.size(); i++)
+			m_workers[i].join();
+		delete[] m_queues;
+	}
+
+	unsigned threads() const { return m_n; }
+
+	// Run the task and everything it spawns; return when all of them are done
+	void run(const task_t& task)
+	{
+		unsigned& self = index();
+		CTaskPool*& pool = owner();
+		unsigned self_prev = self;
+		CTaskPool* pool_prev = pool;
+		self = 0;
+		pool = this;
+
+		spawn(task);
+		while(m_pending.load(std::memory_order_acquire))
+		{
+			if(!run_one(0))
+				std::this_thread::yield();
+		}
+
+		self = self_prev;
+		pool = pool_prev;
+	}
+
+	// Called from a task (or from the run() caller)
+	void spawn(const task_t& task)
+	{
+		unsigned i = (owner() == this) ? index() : 0;
+		m_pending.fetch_add(1, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(m_queues[i].lock);
+			m_queues[i].tasks.push_back(task);
+		}
+		if(m_queued.fetch_add(1, std::memory_order_release) == 0)
+		{
+			std::lock_guard<std::mutex> lock(m_idle_lock);
+		}
+		m_idle.notify_one();
+	}
+
+private:
+	CTaskPool(const CTaskPool&);
+	CTaskPool& operator=(const CTaskPool&);
+
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<task_t> tasks;
+	};
+
+	static unsigned& index() { static thread_local unsigned i = 0; return i; }
+	static CTaskPool*& owner() { static thread_local CTaskPool* p = NULL; return p; }
+
+	bool pop(unsigned f_i, task_t& f_task)
+	{
+		// Own queue: LIFO
+		{
+			Queue& q = m_queues[f_i];
+			std::lock_guard<std::mutex> lock(q.lock);
+			if(!q.tasks.empty())
+			{
+				f_task.swap(q.tasks.back());
+				q.tasks.pop_back();
+				return true;
+			}
+		}
+		// Steal: FIFO
+		for(unsigned k = 1; k < m_n; k++)
+		{
+			Queue& q = m_queues[(f_i + k) % m_n];
+			std::lock_guard<std::mutex> lock(q.lock);
+			if(!q.tasks.empty())
+			{
+				f_task.swap(q.tasks.front());
+				q.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool run_one(unsigned f_i)
+	{
+		task_t task;
+		if(!pop(f_i, task))
+			return false;
+		m_queued.fetch_sub(1, std::memory_order_relaxed);
+		task();
+		m_pending.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	void worker(unsigned f_i)
+	{
+		index() = f_i;
+		owner() = this;
+		for(;;)
+		{
+			if(run_one(f_i))
+				continue;
+			std::unique_lock<std::mutex> lock(m_idle_lock);
+			m_idle.wait(lock, [this]() { return m_stop || m_queued.load(std::memory_order_acquire); });
+			if(m_stop)
+				return;
+		}
+	}
+
+private:
+	const unsigned m_n;
+	Queue* m_queues;
+	std::vector<std::thread> m_workers;
+
+	// Tasks waiting in the queues / not finished yet
+	std::atomic<size_t> m_queued;
+	std::atomic<size_t> m_pending;
+
+	bool m_stop;
+	std::mutex m_idle_lock;
+	std::condition_variable m_idle;
+};
+
+#endif // __PARALLEL_H__
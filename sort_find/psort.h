@@ -0,0 +1,299 @@
+#ifndef __PSORT_H__
+#define __PSORT_H__
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "sort.h"
+#include "parallel.h"
+
+
+// ====================================
+// Parallel Quick Sort: sort_pdq where every left part above the cutoff
+// becomes a task of the work-stealing pool instead of a recursive call
+// (derived from pdqsort, see the notice in sort.h)
+template<class Iter, class Compare, bool Branchless>
+struct PdqFork
+{
+	CTaskPool& Pool;
+	size_t Cutoff;
+	Compare Comp;
+
+	PdqFork(CTaskPool& pool, size_t cutoff, Compare comp): Pool(pool), Cutoff(cutoff), Comp(comp) {}
+
+	void operator()(Iter begin, Iter end, unsigned bad_allowed, bool leftmost)
+	{
+		if((size_t)(end - begin) < Cutoff)
+		{
+			PdqRecurse<Iter, Compare, Branchless> seq(Comp);
+			pdq_loop<Branchless>(begin, end, bad_allowed, leftmost, seq, Comp);
+			return;
+		}
+		PdqFork fork(*this);
+		Pool.spawn([=]() mutable { pdq_loop<Branchless>(begin, end, bad_allowed, leftmost, fork, fork.Comp); });
+	}
+};
+
+template<class Iter, class Compare = typename sort_less<Iter>::type>
+void sort_quick_parallel(Iter a, size_t n, CTaskPool& pool, Compare comp = Compare(), size_t cutoff = 1 << 16)
+{
+	enum { Branchless = sort_branchless<Iter, Compare>::value };
+	if(n < 2)
+		return;
+	PdqFork<Iter, Compare, Branchless> fork(pool, cutoff, comp);
+	pool.run([&]() { pdq_loop<Branchless>(a, a + n, pdq_log2(n), true, fork, comp); });
+}
+
+// ====================================
+// Parallel Heap Sort: sort_heap_dary with the heap built level by level
+// from the bottom up. The subtrees of the nodes of one level are disjoint,
+// so every level is sifted as a few pool tasks; the extraction stays serial.
+enum { HeapLevelGrain = 1 << 12 };
+
+template<unsigned D = 2, class Iter, class Compare = typename sort_less<Iter>::type>
+void sort_heap_parallel(Iter a, size_t n, CTaskPool& pool, Compare comp = Compare())
+{
+	if(n < 2)
+		return;
+
+	// The first node of every level down to the last internal node
+	size_t last = (n - 2) / D;
+	std::vector<size_t> level(1, 0);
+	while(level.back() <= last)
+		level.push_back(D * level.back() + 1);
+
+	for(size_t l = level.size() - 1; l-- > 0;)
+	{
+		size_t lo = level[l], hi = std::min(level[l + 1], last + 1);
+		if(hi - lo < HeapLevelGrain)
+		{
+			for(size_t i = hi; i-- > lo;)
+				sift_down_dary<D>(a, i, n, comp);
+			continue;
+		}
+		pool.run([&]()
+		{
+			for(size_t b = lo; b < hi; b += HeapLevelGrain)
+			{
+				size_t e = std::min(b + HeapLevelGrain, hi);
+				pool.spawn([=]()
+				{
+					for(size_t i = e; i-- > b;)
+						sift_down_dary<D>(a, i, n, comp);
+				});
+			}
+		});
+	}
+
+	for(size_t i = n; i > 1; i--)
+		pop_heap_dary<D>(a, i, comp);
+}
+
+// ====================================
+// Sample Sort
+//
+// 1. Sort a random sample and take evenly spaced splitters from it;
+// 2. classify the items in parallel: between two splitters or equal to
+//    a splitter (so that duplicates never make one huge bucket);
+// 3. scatter the slices to the buckets, each thread to its own offsets;
+// 4. sort the buckets as independent pool tasks (equality buckets are
+//    sorted already).
+enum
+{
+	SampleBucketsPerThread = 8,
+	SampleOversampling = 32,
+	SampleMin = 1 << 16
+};
+
+template<class Iter, class Compare = typename sort_less<Iter>::type>
+void sort_sample(Iter a, size_t n, CTaskPool& pool, Compare comp = Compare(), size_t cutoff = 1 << 16)
+{
+	typedef typename std::iterator_traits<Iter>::value_type Item;
+	unsigned threads = pool.threads();
+	if(n < SampleMin || threads < 2)
+	{
+		sort_pdq(a, n, comp);
+		return;
+	}
+
+	// Splitters
+	size_t k = std::min<size_t>(threads * SampleBucketsPerThread, 1 << 14);
+	std::vector<Item> spl(k * SampleOversampling);
+	uint64_t seed = 0x9E3779B97F4A7C15ull ^ n;
+	for(size_t i = 0; i < spl.size(); i++)
+	{
+		seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+		spl[i] = a[seed % n];
+	}
+	sort_pdq(&spl[0], spl.size(), comp);
+	for(size_t i = 1; i < k; i++)
+		spl[i - 1] = spl[i * SampleOversampling - 1];
+	spl.resize(k - 1);
+	spl.erase(std::unique(spl.begin(), spl.end(), [&](const Item& x, const Item& y) { return !comp(x, y) && !comp(y, x); }), spl.end());
+
+	// Bucket 2j - between the splitters j-1 and j, 2j+1 - equal to the splitter j
+	size_t m = spl.size();
+	size_t buckets = 2 * m + 1;
+	std::vector<uint16_t> id(n);
+	std::vector< std::vector<size_t> > count(threads, std::vector<size_t>(buckets));
+	parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+	{
+		const Item* s = spl.empty() ? NULL : &spl[0];
+		size_t* c = &count[t][0];
+		for(size_t i = begin; i < end; i++)
+		{
+			size_t j = std::lower_bound(s, s + m, a[i], comp) - s;
+			size_t b = 2 * j + (j < m && !comp(a[i], s[j]));
+			id[i] = (uint16_t)b;
+			c[b]++;
+		}
+	});
+
+	// Bucket b of slice t goes after all the smaller buckets and after
+	// the bucket b of the previous slices
+	std::vector<size_t> bound(buckets + 1);
+	for(size_t b = 0, sum = 0; b < buckets; b++)
+	{
+		bound[b] = sum;
+		for(unsigned t = 0; t < threads; t++)
+		{
+			size_t c = count[t][b];
+			count[t][b] = sum;
+			sum += c;
+		}
+	}
+	bound[buckets] = n;
+
+	std::vector<Item> aux(n);
+	parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+	{
+		size_t* o = &count[t][0];
+		for(size_t i = begin; i < end; i++)
+			aux[o[id[i]]++] = std::move(a[i]);
+	});
+
+	// Copy back and sort every bucket in its own task
+	pool.run([&]()
+	{
+		for(size_t b = 0; b < buckets; b++)
+		{
+			size_t lo = bound[b], hi = bound[b + 1];
+			if(lo == hi)
+				continue;
+			pool.spawn([&, b, lo, hi]()
+			{
+				std::move(aux.begin() + lo, aux.begin() + hi, a + lo);
+				if(b & 1)
+					return;
+				PdqFork<Iter, Compare, sort_branchless<Iter, Compare>::value> fork(pool, cutoff, comp);
+				fork(a + lo, a + hi, pdq_log2(hi - lo), true);
+			});
+		}
+	});
+}
+
+// ====================================
+// Parallel Stable Merge Sort
+//
+// The input is cut into a few chunks per thread, sorted as tasks with the
+// ping-pong merge sort, then merged pairwise pass by pass between the array
+// and the scratch. Each merge is split into pieces of the output by
+// co-ranking (merge path), so all the threads work on the last passes too.
+// The chunks land in the scratch when the pass count is odd, which leaves
+// the result in the array with no final copy.
+
+// The number of items of a among the first k items of the stable merge of a and b
+template<class Item, class Compare>
+static size_t co_rank(size_t k, const Item* a, size_t na, const Item* b, size_t nb, Compare comp)
+{
+	size_t lo = (k > nb) ? (k - nb) : 0;
+	size_t hi = (k < na) ? k : na;
+	while(lo < hi)
+	{
+		size_t i = lo + (hi - lo) / 2;
+		// a[i] goes before b[k - i - 1]: take more of a
+		if(!comp(b[k - i - 1], a[i]))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+template<class Item, class Compare = std::less<Item> >
+void sort_merge_parallel(Item* a, size_t n, CTaskPool& pool, Item* buf = NULL, Compare comp = Compare())
+{
+	typedef MergeLeaf<Item*, Compare> Leaf;
+	if(n < 2)
+		return;
+	std::vector<Item> own;
+	if(!buf)
+	{
+		own.resize(n);
+		buf = &own[0];
+	}
+
+	unsigned threads = pool.threads();
+	size_t chunks = std::max<size_t>(1, std::min<size_t>(threads * 4, n / MergeRun));
+	unsigned passes = 0;
+	for(size_t c = 1; c < chunks; c *= 2)
+		passes++;
+
+	std::vector<size_t> bound(chunks + 1);
+	for(size_t c = 0; c <= chunks; c++)
+		bound[c] = slice(n, (unsigned)chunks, (unsigned)c);
+
+	pool.run([&]()
+	{
+		for(size_t c = 0; c < chunks; c++)
+		{
+			pool.spawn([&, c]()
+			{
+				sort_merge_pingpong(a + bound[c], buf + bound[c], bound[c + 1] - bound[c], passes & 1, comp);
+			});
+		}
+	});
+
+	Item* src = (passes & 1) ? buf : a;
+	Item* dst = (passes & 1) ? a : buf;
+	size_t grain = std::max<size_t>(n / (threads * 4), 1 << 12);
+	for(size_t w = 1; w < chunks; w *= 2, std::swap(src, dst))
+	{
+		// All the pieces are co-ranked before any merge moves the items away
+		struct Piece { size_t Lo, Mid, K, I; };
+		std::vector<Piece> pieces;
+		for(size_t c = 0; c < chunks; c += 2 * w)
+		{
+			size_t lo = bound[c];
+			size_t mid = bound[std::min(c + w, chunks)];
+			size_t hi = bound[std::min(c + 2 * w, chunks)];
+			for(size_t k = 0;; k = std::min(k + grain, hi - lo))
+			{
+				Piece p = { lo, mid, k, co_rank(k, src + lo, mid - lo, src + mid, hi - mid, comp) };
+				pieces.push_back(p);
+				if(k == hi - lo)
+					break;
+			}
+		}
+
+		pool.run([&]()
+		{
+			for(size_t i = 0; i + 1 < pieces.size(); i++)
+			{
+				const Piece& p = pieces[i];
+				const Piece& q = pieces[i + 1];
+				if(q.Lo != p.Lo)
+					continue;
+				pool.spawn([&p, &q, src, dst, comp]()
+				{
+					Item* x = src + p.Lo;
+					Item* y = src + p.Mid;
+					Leaf::merge(x + p.I, q.I - p.I, y + (p.K - p.I), (q.K - q.I) - (p.K - p.I), dst + p.Lo + p.K, comp);
+				});
+			}
+		});
+	}
+}
+
+#endif // __PSORT_H__
@@ -0,0 +1,350 @@
+#ifndef __RADIX_H__
+#define __RADIX_H__
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+
+#include "parallel.h"
+
+
+// ====================================
+// Order-preserving mapping of keys onto unsigned integers:
+// signed - flip the sign bit; float - flip the sign bit of positives
+// and all the bits of negatives
+template<unsigned Size> struct radix_uint;
+template<> struct radix_uint<1> { typedef uint8_t  type; };
+template<> struct radix_uint<2> { typedef uint16_t type; };
+template<> struct radix_uint<4> { typedef uint32_t type; };
+template<> struct radix_uint<8> { typedef uint64_t type; };
+
+template<class Key, class Enable = void>
+struct radix_key;
+
+template<class Key>
+struct radix_key<Key, typename std::enable_if<std::is_integral<Key>::value>::type>
+{
+	typedef typename radix_uint<sizeof(Key)>::type type;
+	static type map(Key k)
+	{
+		type u = (type)k;
+		if(std::is_signed<Key>::value)
+			u ^= (type)1 << (sizeof(Key) * 8 - 1);
+		return u;
+	}
+};
+
+template<class Key>
+struct radix_key<Key, typename std::enable_if<std::is_floating_point<Key>::value>::type>
+{
+	typedef typename radix_uint<sizeof(Key)>::type type;
+	static type map(Key k)
+	{
+		type u;
+		memcpy(&u, &k, sizeof(u));
+		type sign = (type)1 << (sizeof(Key) * 8 - 1);
+		return (u & sign) ? ~u : (u | sign);
+	}
+};
+
+struct key_identity
+{
+	template<class T>
+	const T& operator()(const T& x) const { return x; }
+};
+
+// ====================================
+// LSD Radix Sort (stable)
+//
+// One read pass builds the histograms of all the digits; the passes where
+// every key has the same digit are skipped. With several threads every pass
+// counts the digits per slice, and each thread scatters its own slice to
+// the offsets reserved for it, which keeps the sort stable.
+template<unsigned Bits, class Item, class KeyOf>
+void sort_radix_by(Item* a, size_t n, KeyOf key, unsigned threads = 1)
+{
+	typedef typename std::decay<decltype(key(*a))>::type Key;
+	typedef radix_key<Key> RK;
+	typedef typename RK::type UKey;
+
+	static const unsigned Radix = 1u << Bits;
+	static const unsigned Mask = Radix - 1;
+	static const unsigned Passes = (sizeof(UKey) * 8 + Bits - 1) / Bits;
+
+	if(n < 2)
+		return;
+	if(!threads)
+		threads = 1;
+	if(threads > n)
+		threads = (unsigned)n;
+
+	// Histograms of all the digits (per thread, then summed up)
+	std::vector< std::vector<size_t> > local(threads, std::vector<size_t>(Passes * Radix));
+	parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+	{
+		size_t* h = &local[t][0];
+		for(size_t i = begin; i < end; i++)
+		{
+			UKey u = RK::map(key(a[i]));
+			for(unsigned p = 0; p < Passes; p++)
+				h[p * Radix + ((u >> (p * Bits)) & Mask)]++;
+		}
+	});
+	std::vector<size_t> count(Passes * Radix);
+	for(unsigned t = 0; t < threads; t++)
+	{
+		for(unsigned i = 0; i < Passes * Radix; i++)
+			count[i] += local[t][i];
+	}
+
+	std::vector<Item> aux(n);
+	Item* src = a;
+	Item* dst = &aux[0];
+	std::vector< std::vector<size_t> > offset(threads, std::vector<size_t>(Radix));
+	bool moved = false;
+
+	for(unsigned p = 0; p < Passes; p++)
+	{
+		const size_t* c = &count[p * Radix];
+		unsigned shift = p * Bits;
+
+		// All the keys have the same digit: nothing to do
+		if(c[(RK::map(key(src[0])) >> shift) & Mask] == n)
+			continue;
+
+		// Per-slice digit counts: the initial ones hold until the order changes
+		std::vector<const size_t*> h(threads, c);
+		for(unsigned t = 0; t < threads && threads > 1; t++)
+			h[t] = &local[t][moved ? 0 : p * Radix];
+		if(threads > 1 && moved)
+		{
+			parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+			{
+				size_t* ht = &local[t][0];
+				memset(ht, 0, Radix * sizeof(size_t));
+				for(size_t i = begin; i < end; i++)
+					ht[(RK::map(key(src[i])) >> shift) & Mask]++;
+			});
+		}
+
+		// Digit d of slice t goes after all the smaller digits and
+		// after the digit d of the previous slices
+		for(size_t d = 0, sum = 0; d < Radix; d++)
+		{
+			for(unsigned t = 0; t < threads; t++)
+			{
+				offset[t][d] = sum;
+				sum += h[t][d];
+			}
+		}
+
+		parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+		{
+			size_t* o = &offset[t][0];
+			for(size_t i = begin; i < end; i++)
+				dst[o[(RK::map(key(src[i])) >> shift) & Mask]++] = src[i];
+		});
+		std::swap(src, dst);
+		moved = true;
+	}
+
+	if(src != a)
+	{
+		parallel_for(n, threads, [&](unsigned, size_t begin, size_t end)
+		{
+			for(size_t i = begin; i < end; i++)
+				a[i] = src[i];
+		});
+	}
+}
+
+// 11-bit digits: 3 passes for 32-bit keys, 2K counters fit L1
+template<class Item, class KeyOf>
+void sort_radix_by(Item* a, size_t n, KeyOf key, unsigned threads = 1)
+{
+	sort_radix_by<11>(a, n, key, threads);
+}
+
+template<class Item>
+void sort_radix(Item* a, size_t n, unsigned threads = 1)
+{
+	sort_radix_by<11>(a, n, key_identity(), threads);
+}
+
+// ====================================
+// Counting Sort of items with integer keys from a small known range [lo, hi]
+//
+// The histogram of the keys is counted per slice of the items, one thread
+// per slice, and turned into the offsets of every key in every slice: the
+// key k of slice t goes after all the smaller keys and after the key k of
+// the previous slices. Each thread then scatters its own slice, so the
+// sort is stable, ascending or descending.
+// - sort_counting_copy_by: the sorted items go to another buffer;
+// - sort_counting_by: the same through a scratch buffer;
+// - sort_flag_by: American flag sort, in place with no scratch: every item
+//   is swapped straight into the next free slot of its key. The cycles of
+//   the swaps run in one thread and do not keep the order of equal keys;
+// - sort_counting: the items are the keys, so the counts are the result.
+
+// The slot of the key k in the histogram
+template<class Key>
+struct CountingBucket
+{
+	typedef radix_key<Key> RK;
+
+	CountingBucket(Key lo, Key hi, bool descending):
+		Lo(RK::map(lo)), Last((size_t)(RK::map(hi) - Lo)), Descending(descending) {}
+
+	size_t size() const { return Last + 1; }
+	size_t operator()(Key k) const
+	{
+		size_t b = (size_t)(RK::map(k) - Lo);
+		return Descending ? Last - b : b;
+	}
+
+	typename RK::type Lo;
+	size_t Last;
+	bool Descending;
+};
+
+// Per-slice histograms: count[t][b] - the keys b in the slice t
+template<class Item, class KeyOf, class Key>
+static void counting_histogram(const Item* a, size_t n, KeyOf key, const CountingBucket<Key>& bucket,
+							   std::vector< std::vector<size_t> >& count, unsigned threads)
+{
+	count.assign(threads, std::vector<size_t>(bucket.size()));
+	parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+	{
+		size_t* c = &count[t][0];
+		for(size_t i = begin; i < end; i++)
+			c[bucket((Key)key(a[i]))]++;
+	});
+}
+
+// src to dst, stable; moves unless src is const
+template<class Src, class Item, class KeyOf, class Key>
+static void counting_scatter(Src src, size_t n, KeyOf key, Key lo, Key hi, bool descending, Item* dst, unsigned threads)
+{
+	if(!threads)
+		threads = 1;
+	if(threads > n)
+		threads = n ? (unsigned)n : 1;
+	CountingBucket<Key> bucket(lo, hi, descending);
+	std::vector< std::vector<size_t> > offset;
+	counting_histogram(src, n, key, bucket, offset, threads);
+
+	for(size_t b = 0, sum = 0; b < bucket.size(); b++)
+	{
+		for(unsigned t = 0; t < threads; t++)
+		{
+			size_t c = offset[t][b];
+			offset[t][b] = sum;
+			sum += c;
+		}
+	}
+
+	parallel_for(n, threads, [&](unsigned t, size_t begin, size_t end)
+	{
+		size_t* o = &offset[t][0];
+		for(size_t i = begin; i < end; i++)
+			dst[o[bucket((Key)key(src[i]))]++] = std::move(src[i]);
+	});
+}
+
+template<class Item, class KeyOf, class Key>
+void sort_counting_copy_by(const Item* a, size_t n, KeyOf key, Key lo, Key hi, Item* out,
+						   bool descending = false, unsigned threads = 1)
+{
+	counting_scatter(a, n, key, lo, hi, descending, out, threads);
+}
+
+template<class Item, class KeyOf, class Key>
+void sort_counting_by(Item* a, size_t n, KeyOf key, Key lo, Key hi, bool descending = false, unsigned threads = 1)
+{
+	if(n < 2)
+		return;
+	std::vector<Item> aux(n);
+	counting_scatter(a, n, key, lo, hi, descending, &aux[0], threads);
+	parallel_for(n, threads ? threads : 1, [&](unsigned, size_t begin, size_t end)
+	{
+		std::move(aux.begin() + begin, aux.begin() + end, a + begin);
+	});
+}
+
+template<class Item, class KeyOf, class Key>
+void sort_flag_by(Item* a, size_t n, KeyOf key, Key lo, Key hi, bool descending = false, unsigned threads = 1)
+{
+	if(n < 2)
+		return;
+	if(!threads)
+		threads = 1;
+	if(threads > n)
+		threads = (unsigned)n;
+	CountingBucket<Key> bucket(lo, hi, descending);
+	std::vector< std::vector<size_t> > count;
+	counting_histogram(a, n, key, bucket, count, threads);
+
+	// [next[b], end[b]): the slots of the key b not filled yet
+	std::vector<size_t> next(bucket.size()), end(bucket.size());
+	for(size_t b = 0, sum = 0; b < bucket.size(); b++)
+	{
+		next[b] = sum;
+		for(unsigned t = 0; t < threads; t++)
+			sum += count[t][b];
+		end[b] = sum;
+	}
+
+	for(size_t b = 0; b < bucket.size(); b++)
+	{
+		while(next[b] < end[b])
+		{
+			size_t d = bucket((Key)key(a[next[b]]));
+			if(d == b)
+			{
+				next[b]++;
+				continue;
+			}
+			// Follow the cycle until an item of b comes out
+			Item tmp = std::move(a[next[b]]);
+			do
+			{
+				using std::swap;
+				swap(tmp, a[next[d]++]);
+				d = bucket((Key)key(tmp));
+			}
+			while(d != b);
+			a[next[b]++] = std::move(tmp);
+		}
+	}
+}
+
+template<class Item>
+void sort_counting(Item* a, size_t n, Item lo, Item hi, bool descending = false, unsigned threads = 1)
+{
+	static_assert(std::is_integral<Item>::value, "sort_counting: integer items only");
+	if(n < 2)
+		return;
+	if(!threads)
+		threads = 1;
+	if(threads > n)
+		threads = (unsigned)n;
+	CountingBucket<Item> bucket(lo, hi, descending);
+	std::vector< std::vector<size_t> > count;
+	counting_histogram(a, n, key_identity(), bucket, count, threads);
+
+	typedef typename radix_key<Item>::type UKey;
+	for(size_t b = 0, i = 0; b < bucket.size(); b++)
+	{
+		size_t d = descending ? bucket.Last - b : b;
+		Item v = (Item)((UKey)lo + (UKey)d);
+		for(unsigned t = 0; t < threads; t++)
+		{
+			for(size_t c = count[t][b]; c; c--)
+				a[i++] = v;
+		}
+	}
+}
+
+#endif // __RADIX_H__
@@ -1,38 +1,507 @@
 #ifndef __SEARCH_H__
 #define __SEARCH_H__
 
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <cstddef>
+#include <stdint.h>
+
+#include "simd.h"
+
 
 static const int& get_key(const int& item) { return item; }
 
 // ====================================
-// Binary search
+// Branchless binary search: the range halves every step whatever the
+// comparison gives, so the only branch is the loop; the choice of the half
+// is a conditional move. Both possible middles of the next step are
+// prefetched while this one is compared.
+// The index of the first item not less than the key, n if there is none.
 template<class Key, class Item>
-Item* find_binary(const Key& key, /*const*/ Item* a, unsigned n)
+size_t lower_bound_branchless(const Key& key, const Item* a, size_t n)
 {
 	if(!n)
-		return NULL;
+		return 0;
+	const Item* base = a;
+	while(n > 1)
+	{
+		size_t half = n / 2;
+		__builtin_prefetch(base + half / 2);
+		__builtin_prefetch(base + half + half / 2);
+		base = (get_key(base[half]) < key) ? base + half : base;
+		n -= half;
+	}
+	return (base - a) + (get_key(*base) < key);
+}
+
+// ====================================
+// Binary search: the first item with the key (the lower bound, so heavy
+// duplicates cost nothing extra), NULL if there is none
+template<class Key, class Item>
+Item* find_binary(const Key& key, /*const*/ Item* a, unsigned n)
+{
+	size_t i = lower_bound_branchless(key, a, n);
+	return (i < n && get_key(a[i]) == key) ? &a[i] : NULL;
+}
+
+// ====================================
+// Batched lookups: out[i] is the result for keys[i]. A single search
+// waits for one cache miss per step; SearchGroup independent searches go
+// step by step side by side instead, so their misses overlap.
+enum { SearchGroup = 16 };
 
-	// For interpolation search c = (key - a[0]) / (a[n - 1] - a[0]
-	unsigned m = n / 2;
-	Key k = get_key(a[m]);
-	// 3-way partition style
-	if(key == k)
+// The halving of the branchless search does not depend on the key: all
+// the searches of a group take the same steps over ranges of the same size
+template<class Key, class Item>
+void lower_bound_many(const Key* keys, size_t m, const Item* a, size_t n, size_t* out)
+{
+	for(size_t i = 0; i < m; i += SearchGroup)
 	{
-		// Return the first element in the range
-		for(; m > 0 && get_key(a[m - 1]) == key; m--) {}
-		return &a[m];
+		size_t g = std::min<size_t>(SearchGroup, m - i);
+		const Item* base[SearchGroup];
+		for(size_t j = 0; j < g; j++)
+			base[j] = a;
+		for(size_t len = n; len > 1; len -= len / 2)
+		{
+			size_t half = len / 2;
+			for(size_t j = 0; j < g; j++)
+			{
+				base[j] = (get_key(base[j][half]) < keys[i + j]) ? base[j] + half : base[j];
+				__builtin_prefetch(base[j] + (len - half) / 2);
+			}
+		}
+		for(size_t j = 0; j < g; j++)
+			out[i + j] = n ? (base[j] - a) + (get_key(*base[j]) < keys[i + j]) : 0;
 	}
+}
 
-	// Everything is ready for the next iteration if key < k
-	if(key > k)
+template<class Key, class Item>
+void find_many(const Key* keys, size_t m, /*const*/ Item* a, unsigned n, Item** out)
+{
+	for(size_t i = 0; i < m; i += SearchGroup)
 	{
-		m++;
-		a += m;
-		m = n - m;
+		size_t g = std::min<size_t>(SearchGroup, m - i);
+		size_t at[SearchGroup];
+		lower_bound_many(keys + i, g, a, n, at);
+		for(size_t j = 0; j < g; j++)
+			out[i + j] = (at[j] < n && get_key(a[at[j]]) == keys[i + j]) ? &a[at[j]] : NULL;
 	}
-	return find_binary(key, a, m);
 }
 
+// ====================================
+// Eytzinger search index over a sorted array
+//
+// The keys are laid out in the BFS order of the implicit binary search
+// tree: the root at 1, the children of k at 2k and 2k + 1. The search is a
+// branchless descent. The B descendants of k log2(B) levels down, Bk ..
+// Bk + B - 1, are adjacent: with the keys aligned to the cache line and B
+// keys per line (16 ints), one prefetch brings in the line the search
+// needs four steps later.
+// The lower bound is the last node where the search went left: the
+// trailing ones of the final k are the right turns after it.
+template<class Key, class Item, class Index = uint32_t>
+class CEytzinger
+{
+public:
+	CEytzinger(const Item* f_a, size_t f_n):
+		m_a(f_a), m_n(f_n), m_buf(f_n + 1 + Line / sizeof(Key)), m_index(f_n + 1)
+	{
+		// Align the node 0 (unused) to the cache line
+		uintptr_t p = (uintptr_t)&m_buf[0];
+		m_keys = &m_buf[0] + ((Line - p % Line) % Line) / sizeof(Key);
+		build(0, 1);
+	}
+
+	// The index in the sorted array of the first item not less than the key, n if none
+	size_t lower_bound(const Key& f_key) const
+	{
+		enum { Ahead = Line / sizeof(Key) > 1 ? Line / sizeof(Key) : 2 };
+		size_t k = 1;
+		while(k <= m_n)
+		{
+			__builtin_prefetch(m_keys + k * Ahead);
+			k = 2 * k + (m_keys[k] < f_key);
+		}
+		k >>= __builtin_ffsll((long long)~k);
+		return k ? (size_t)m_index[k] : m_n;
+	}
+
+	const Item* find(const Key& f_key) const
+	{
+		size_t i = lower_bound(f_key);
+		return (i < m_n && get_key(m_a[i]) == f_key) ? &m_a[i] : NULL;
+	}
+
+	// A group of searches descends level by level; on the last, partial
+	// level only some of them are still in the tree. The group overlaps the
+	// misses well enough: the prefetch ahead only costs time here.
+	void lower_bound_many(const Key* f_keys, size_t f_m, size_t* f_out) const
+	{
+		for(size_t i = 0; i < f_m; i += SearchGroup)
+		{
+			size_t g = std::min<size_t>(SearchGroup, f_m - i);
+			size_t k[SearchGroup];
+			for(size_t j = 0; j < g; j++)
+				k[j] = 1;
+			size_t level = 1;
+			for(; 2 * level - 1 <= m_n; level *= 2)
+			{
+				for(size_t j = 0; j < g; j++)
+					k[j] = 2 * k[j] + (m_keys[k[j]] < f_keys[i + j]);
+			}
+			if(level <= m_n)
+			{
+				for(size_t j = 0; j < g; j++)
+				{
+					if(k[j] <= m_n)
+						k[j] = 2 * k[j] + (m_keys[k[j]] < f_keys[i + j]);
+				}
+			}
+			for(size_t j = 0; j < g; j++)
+			{
+				size_t r = k[j] >> __builtin_ffsll((long long)~k[j]);
+				f_out[i + j] = r ? (size_t)m_index[r] : m_n;
+			}
+		}
+	}
+
+	void find_many(const Key* f_keys, size_t f_m, const Item** f_out) const
+	{
+		for(size_t i = 0; i < f_m; i += SearchGroup)
+		{
+			size_t g = std::min<size_t>(SearchGroup, f_m - i);
+			size_t at[SearchGroup];
+			lower_bound_many(f_keys + i, g, at);
+			for(size_t j = 0; j < g; j++)
+				f_out[i + j] = (at[j] < m_n && get_key(m_a[at[j]]) == f_keys[i + j]) ? &m_a[at[j]] : NULL;
+		}
+	}
+
+private:
+	enum { Line = 64 };
+
+	// In-order traversal of the tree takes the items in the sorted order
+	size_t build(size_t f_i, size_t f_k)
+	{
+		if(f_k > m_n)
+			return f_i;
+		f_i = build(f_i, 2 * f_k);
+		m_keys[f_k] = get_key(m_a[f_i]);
+		m_index[f_k] = (Index)f_i;
+		return build(f_i + 1, 2 * f_k + 1);
+	}
+
+private:
+	const Item* m_a;
+	size_t m_n;
+	std::vector<Key> m_buf;
+	Key* m_keys;
+	std::vector<Index> m_index;
+};
+
+// ====================================
+// SIMD k-ary search tree (static B+ tree) over a sorted array
+//
+// Every node is a cache line of keys: 16 ints, one query is compared with
+// all of them at once (two AVX2 compares) and the number of the keys less
+// than the query is the child to go to, out of 17. The leaves are the
+// sorted keys; every key of an inner node is the smallest key of the
+// subtree to the right of it. The levels are stored from the root down,
+// so the top levels - a few hundred nodes - share the first pages and
+// stay in the TLB and the cache; the lower levels are read one line per
+// level. The last nodes of the levels are padded with the largest key.
+template<class Key>
+static unsigned simd_tree_rank(const Key* node, unsigned size, const Key& key)
+{
+	unsigned r = 0;
+	for(unsigned i = 0; i < size; i++)
+		r += (node[i] < key);
+	return r;
+}
+
+#if SORT_SIMD_LANES == 8
+static inline unsigned simd_tree_rank(const int* node, unsigned size, int key)
+{
+	if(size != 16)
+		return simd_tree_rank<int>(node, size, key);
+	__m256i k = _mm256_set1_epi32(key);
+	__m256i lo = _mm256_cmpgt_epi32(k, _mm256_load_si256((const __m256i*)node));
+	__m256i hi = _mm256_cmpgt_epi32(k, _mm256_load_si256((const __m256i*)(node + 8)));
+	unsigned m = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lo)) |
+				 ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+	return (unsigned)__builtin_popcount(m);
+}
+
+static inline unsigned simd_tree_rank(const float* node, unsigned size, float key)
+{
+	if(size != 16)
+		return simd_tree_rank<float>(node, size, key);
+	__m256 k = _mm256_set1_ps(key);
+	__m256 lo = _mm256_cmp_ps(_mm256_load_ps(node), k, _CMP_LT_OQ);
+	__m256 hi = _mm256_cmp_ps(_mm256_load_ps(node + 8), k, _CMP_LT_OQ);
+	unsigned m = (unsigned)_mm256_movemask_ps(lo) | ((unsigned)_mm256_movemask_ps(hi) << 8);
+	return (unsigned)__builtin_popcount(m);
+}
+#endif
+
+template<class Key, class Item>
+class CSimdTree
+{
+public:
+	CSimdTree(const Item* f_a, size_t f_n): m_a(f_a), m_n(f_n)
+	{
+		// Nodes per level, the leaves first
+		std::vector<size_t> nodes(1, std::max<size_t>(1, (f_n + B - 1) / B));
+		while(nodes.back() > 1)
+			nodes.push_back((nodes.back() + B) / (B + 1));
+		size_t total = 0;
+		for(size_t l = 0; l < nodes.size(); l++)
+			total += nodes[l];
+
+		m_buf.resize(total * B + Line / sizeof(Key), pad());
+		uintptr_t p = (uintptr_t)&m_buf[0];
+		m_keys = &m_buf[0] + ((Line - p % Line) % Line) / sizeof(Key);
+
+		// m_level[h]: the first node of the level h from the root
+		m_level.resize(nodes.size());
+		for(size_t h = 0, at = 0; h < nodes.size(); h++)
+		{
+			m_level[h] = at;
+			at += nodes[nodes.size() - 1 - h];
+		}
+
+		Key* leaves = m_keys + m_level.back() * B;
+		for(size_t i = 0; i < f_n; i++)
+			leaves[i] = get_key(f_a[i]);
+
+		// The child j + 1 of the node k at the distance d from the leaves
+		// starts with the leaf (k * (B + 1) + j + 1) * (B + 1) ^ (d - 1)
+		size_t span = 1;
+		for(size_t d = 1; d < nodes.size(); d++, span *= B + 1)
+		{
+			Key* level = m_keys + m_level[nodes.size() - 1 - d] * B;
+			for(size_t k = 0; k < nodes[d]; k++)
+			{
+				for(size_t j = 0; j < B; j++)
+				{
+					size_t child = k * (B + 1) + j + 1;
+					if(child < nodes[d - 1])
+						level[k * B + j] = leaves[child * span * B];
+				}
+			}
+		}
+	}
+
+	// The index of the first item not less than the key, n if none
+	size_t lower_bound(const Key& f_key) const
+	{
+		size_t k = 0;
+		size_t leaf = m_level.size() - 1;
+		for(size_t h = 0; h < leaf; h++)
+			k = k * (B + 1) + simd_tree_rank(m_keys + (m_level[h] + k) * B, B, f_key);
+		size_t i = k * B + simd_tree_rank(m_keys + (m_level[leaf] + k) * B, B, f_key);
+		return std::min(i, m_n);
+	}
+
+	const Item* find(const Key& f_key) const
+	{
+		size_t i = lower_bound(f_key);
+		return (i < m_n && get_key(m_a[i]) == f_key) ? &m_a[i] : NULL;
+	}
+
+private:
+	enum { Line = 64, B = Line / sizeof(Key) > 1 ? Line / sizeof(Key) : 1 };
+
+	// Never less than a key
+	static Key pad()
+	{
+		return std::numeric_limits<Key>::has_infinity ? std::numeric_limits<Key>::infinity() : std::numeric_limits<Key>::max();
+	}
+
+private:
+	const Item* m_a;
+	size_t m_n;
+	std::vector<Key> m_buf;
+	Key* m_keys;
+	std::vector<size_t> m_level;
+};
+
+// ====================================
+// Learned index over a sorted array of integers
+//
+// The positions of the keys are approximated by linear segments, each
+// within Eps of every position it covers; a lookup predicts the position
+// and finishes with a binary search over the 2 Eps + 3 items around it.
+// - The segments are built in one pass (shrinking cone): the slopes that
+//   keep all the points of the segment within Eps form a range that only
+//   narrows with every point; the segment ends when it is empty. A point
+//   is a distinct key and the index of its first item; after a run of
+//   duplicates the point (key + 1, the end of the run) is added too
+//   (unless it is the next point), so that the keys between two stored
+//   ones are predicted within Eps of their lower bound as well;
+// - the segment of a key is found as in RadixSpline: a table indexed by
+//   the top bits of key - min gives the few segments sharing them.
+template<class Key, class Item>
+class CLearnedIndex
+{
+public:
+	CLearnedIndex(const Item* f_a, size_t f_n, size_t f_eps = 32): m_a(f_a), m_n(f_n), m_eps(f_eps), m_shift(0)
+	{
+		static_assert(std::is_integral<Key>::value, "CLearnedIndex: integer keys only");
+		if(!f_n)
+			return;
+		m_min = get_key(f_a[0]);
+		m_max = get_key(f_a[f_n - 1]);
+
+		Cone cone;
+		for(size_t i = 0; i < f_n;)
+		{
+			Key k = get_key(f_a[i]);
+			size_t j = i + 1;
+			for(; j < f_n && get_key(f_a[j]) == k; j++) {}
+			add(cone, k, i);
+			if(j - i > 1 && k < m_max && get_key(f_a[j]) != k + 1)
+				add(cone, (Key)(k + 1), j);
+			i = j;
+		}
+		close(cone);
+		m_first.reserve(m_seg.size());
+		for(size_t s = 0; s < m_seg.size(); s++)
+			m_first.push_back(m_seg[s].First);
+
+		// About two segments per slot of the table; m_table[t] is the first
+		// segment with the top bits t or more
+		uint64_t range = offset(m_max);
+		while((range >> m_shift) > std::max<uint64_t>(m_seg.size() / 2, 1))
+			m_shift++;
+		m_table.resize((size_t)(range >> m_shift) + 2);
+		for(size_t t = 0, seg = 0; t < m_table.size(); t++)
+		{
+			for(; seg < m_seg.size() && (offset(m_seg[seg].First) >> m_shift) < t; seg++) {}
+			m_table[t] = (uint32_t)seg;
+		}
+	}
+
+	// The index of the first item not less than the key, n if none
+	size_t lower_bound(const Key& f_key) const
+	{
+		if(!m_n || f_key <= m_min)
+			return 0;
+		if(f_key > m_max)
+			return m_n;
+
+		// The last segment starting at or before the key
+		size_t t = (size_t)(offset(f_key) >> m_shift);
+		size_t lo = m_table[t], hi = m_table[t + 1];
+		size_t s = lo + upper_bound(m_first.data() + lo, hi - lo, f_key) - 1;
+		const Segment& seg = m_seg[s];
+		size_t end = (s + 1 < m_seg.size()) ? m_seg[s + 1].Start : m_n;
+
+		// The last mile
+		double p = seg.Start + seg.Slope * (double)offset(f_key, seg.First);
+		size_t at = (p < (double)end) ? (size_t)p : end;
+		size_t b = (at > seg.Start + m_eps + 1) ? at - m_eps - 1 : seg.Start;
+		size_t e = std::min(at + m_eps + 2, end);
+		return b + lower_bound_branchless(f_key, m_a + b, e - b);
+	}
+
+	const Item* find(const Key& f_key) const
+	{
+		size_t i = lower_bound(f_key);
+		return (i < m_n && get_key(m_a[i]) == f_key) ? &m_a[i] : NULL;
+	}
+
+	size_t segments() const { return m_seg.size(); }
+	size_t memory() const
+	{
+		return m_seg.size() * (sizeof(Segment) + sizeof(Key)) + m_table.size() * sizeof(uint32_t);
+	}
+
+private:
+	struct Segment
+	{
+		Key First;
+		size_t Start;
+		double Slope;
+	};
+
+	// The segment being built: its first point and the slopes left
+	struct Cone
+	{
+		Cone(): Open(false), X(), Y(0), Lo(0), Hi(0) {}
+
+		bool Open;
+		Key X;
+		size_t Y;
+		double Lo, Hi;
+	};
+
+	static uint64_t offset(Key f_key, Key f_base) { return (uint64_t)f_key - (uint64_t)f_base; }
+	uint64_t offset(Key f_key) const { return offset(f_key, m_min); }
+
+	void add(Cone& f_c, Key f_x, size_t f_y)
+	{
+		if(f_c.Open)
+		{
+			double dx = (double)offset(f_x, f_c.X);
+			double lo = ((double)f_y - (double)f_c.Y - (double)m_eps) / dx;
+			double hi = ((double)f_y - (double)f_c.Y + (double)m_eps) / dx;
+			if(lo <= f_c.Hi && hi >= f_c.Lo)
+			{
+				f_c.Lo = std::max(f_c.Lo, lo);
+				f_c.Hi = std::min(f_c.Hi, hi);
+				return;
+			}
+			close(f_c);
+		}
+		f_c.Open = true;
+		f_c.X = f_x;
+		f_c.Y = f_y;
+		f_c.Lo = 0;
+		f_c.Hi = std::numeric_limits<double>::infinity();
+	}
+
+	void close(Cone& f_c)
+	{
+		if(!f_c.Open)
+			return;
+		Segment seg = { f_c.X, f_c.Y, (f_c.Hi < std::numeric_limits<double>::infinity()) ? (f_c.Lo + f_c.Hi) / 2 : 0 };
+		m_seg.push_back(seg);
+		f_c.Open = false;
+	}
+
+	// The number of the keys not greater than the key
+	static size_t upper_bound(const Key* f_a, size_t f_n, const Key& f_key)
+	{
+		size_t i = 0;
+		while(f_n > 0)
+		{
+			size_t half = f_n / 2;
+			if(f_key < f_a[i + half])
+				f_n = half;
+			else
+			{
+				i += half + 1;
+				f_n -= half + 1;
+			}
+		}
+		return i;
+	}
+
+private:
+	const Item* m_a;
+	size_t m_n;
+	size_t m_eps;
+	Key m_min;
+	Key m_max;
+	unsigned m_shift;
+	std::vector<Segment> m_seg;
+	std::vector<Key> m_first;
+	std::vector<uint32_t> m_table;
+};
+
 // ====================================
 // BST (Binary Search Tree)
 template<class Key, class Item>
@@ -76,14 +545,57 @@ public:
 	{
 		for(Node* c = head; c;)
 		{
-			const Key& k = get_key(*c->items[0]);
-			if(key == k)
+			if(key == c->key)
 				return c->items[0];
-			c = c->next[(key < k) ? Node::ChildLeft : Node::ChildRight];
+			c = c->next[(key < c->key) ? Node::ChildLeft : Node::ChildRight];
 		}
 		return NULL;
 	}
 
+	// The paths of the searches have different lengths: a finished search
+	// hands its slot of the group over to the next key right away
+	void find_many(const Key* keys, size_t n, Item** out)
+	{
+		Node* cur[SearchGroup];
+		size_t at[SearchGroup];
+		unsigned active = 0;
+		size_t next = 0;
+		for(; active < SearchGroup && next < n; active++, next++)
+		{
+			cur[active] = head;
+			at[active] = next;
+		}
+
+		while(active)
+		{
+			for(unsigned g = 0; g < active;)
+			{
+				Node* c = cur[g];
+				const Key& key = keys[at[g]];
+				if(c && !(key == c->key))
+				{
+					c = c->next[(key < c->key) ? Node::ChildLeft : Node::ChildRight];
+					__builtin_prefetch(c);
+					cur[g++] = c;
+					continue;
+				}
+
+				out[at[g]] = c ? c->items[0] : NULL;
+				if(next < n)
+				{
+					cur[g] = head;
+					at[g++] = next++;
+				}
+				else
+				{
+					active--;
+					cur[g] = cur[active];
+					at[g] = at[active];
+				}
+			}
+		}
+	}
+
 private:
 	struct Node
 	{
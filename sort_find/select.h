@@ -0,0 +1,242 @@
+#ifndef __SELECT_H__
+#define __SELECT_H__
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include "sort.h"
+
+
+// ====================================
+// Selection: rearrange a[0, n) so that a[k] is the item which would be
+// there after sorting, nothing before it is greater and nothing after it
+// is less (std::nth_element). Every step moves a pivot to the end of the
+// range and narrows the range to the side of partition3 holding k, so
+// runs of equal items are settled at once.
+enum { SelectSmall = 16, SelectSample = 600 };
+
+// Partition [lo, hi) around a[p]; narrow it to the part holding k,
+// return false when k falls into the items equal to the pivot
+template<class Item>
+static bool select_step(Item* a, size_t& lo, size_t& hi, size_t p, size_t k)
+{
+	exch(a[p], a[hi - 1]);
+	PartitionBounds b = partition3(a + lo, hi - lo);
+	if(k < lo + b.Equal)
+		hi = lo + b.Equal;
+	else if(k >= lo + b.Greater)
+		lo += b.Greater;
+	else
+		return false;
+	return true;
+}
+
+// Median of medians of 5: a pivot with at least 3/10 of the items on
+// either side. The medians are gathered at the front and selected the
+// same way, which makes the whole selection linear in the worst case.
+template<class Item>
+static void select_mom(Item* a, size_t n, size_t k);
+
+template<class Item>
+static size_t select_mom_pivot(Item* a, size_t n)
+{
+	if(n <= 5)
+	{
+		pdq_insertion(a, a + n);
+		return n / 2;
+	}
+	size_t m = 0;
+	for(size_t i = 0; i + 5 <= n; i += 5, m++)
+	{
+		pdq_insertion(a + i, a + i + 5);
+		exch(a[m], a[i + 2]);
+	}
+	select_mom(a, m, m / 2);
+	return m / 2;
+}
+
+template<class Item>
+static void select_mom(Item* a, size_t n, size_t k)
+{
+	size_t lo = 0, hi = n;
+	while(hi - lo > SelectSmall)
+	{
+		if(!select_step(a, lo, hi, lo + select_mom_pivot(a + lo, hi - lo), k))
+			return;
+	}
+	pdq_insertion(a + lo, a + hi);
+}
+
+// Introselect: quickselect with a median-of-3 (ninther for large ranges)
+// pivot; after log2(n) steps that fail to drop a quarter of the range the
+// pivots come from the median of medians
+template<class Item>
+void select_intro(Item* a, size_t n, size_t k)
+{
+	if(k >= n)
+		return;
+	size_t lo = 0, hi = n;
+	unsigned bad_allowed = pdq_log2(n);
+	while(hi - lo > SelectSmall)
+	{
+		size_t m = hi - lo;
+		if(!bad_allowed)
+		{
+			select_mom(a + lo, m, k - lo);
+			return;
+		}
+
+		size_t p = lo + m / 2;
+		if(m > PdqNinther)
+		{
+			pdq_sort3(a + lo, a + p, a + hi - 1);
+			pdq_sort3(a + lo + 1, a + p - 1, a + hi - 2);
+			pdq_sort3(a + lo + 2, a + p + 1, a + hi - 3);
+			pdq_sort3(a + p - 1, a + p, a + p + 1);
+		}
+		else
+			pdq_sort3(a + lo, a + p, a + hi - 1);
+
+		if(!select_step(a, lo, hi, p, k))
+			return;
+		if(hi - lo > m / 4 * 3)
+			bad_allowed--;
+	}
+	pdq_insertion(a + lo, a + hi);
+}
+
+// Floyd-Rivest: select k in a random-ish sample of about n^(2/3) items
+// around the expected rank first (recursively), so that the pivot lands
+// next to k and each step drops most of the range. About n + min(k, n - k)
+// comparisons on average, against ~2-3n of quickselect. The same
+// fallback as in select_intro covers inputs defeating the sampling.
+template<class Item>
+void select_floyd_rivest(Item* a, size_t n, size_t k)
+{
+	if(k >= n)
+		return;
+	size_t lo = 0, hi = n;
+	unsigned bad_allowed = pdq_log2(n);
+	while(hi - lo > SelectSmall)
+	{
+		size_t m = hi - lo;
+		if(!bad_allowed)
+		{
+			select_mom(a + lo, m, k - lo);
+			return;
+		}
+
+		size_t p = k;
+		if(m > SelectSample)
+		{
+			// Sample [slo, shi) around k, sized and shifted as in the original
+			double z = log((double)m);
+			double s = 0.5 * exp(2 * z / 3);
+			double i = (double)(k - lo) + 1;
+			double sd = 0.5 * sqrt(z * s * (m - s) / m) * ((i < m / 2.0) ? -1 : 1);
+			double l = (double)k - i * s / m + sd;
+			double r = (double)k + (m - i) * s / m + sd;
+			size_t slo = (l > (double)lo) ? (size_t)l : lo;
+			size_t shi = (r + 1 < (double)hi) ? (size_t)(r + 1) : hi;
+			if(slo < shi && k >= slo && k < shi)
+				select_floyd_rivest(a + slo, shi - slo, k - slo);
+		}
+		else
+		{
+			p = lo + m / 2;
+			pdq_sort3(a + lo, a + p, a + hi - 1);
+		}
+
+		if(!select_step(a, lo, hi, p, k))
+			return;
+		if(hi - lo > m / 4 * 3)
+			bad_allowed--;
+	}
+	pdq_insertion(a + lo, a + hi);
+}
+
+template<class Item>
+void select_nth(Item* a, size_t n, size_t k)
+{
+	select_floyd_rivest(a, n, k);
+}
+
+// ====================================
+// Partial sort: the k smallest items in order in a[0, k), the rest
+// in any order after them (std::partial_sort)
+template<class Item>
+void sort_partial(Item* a, size_t n, size_t k)
+{
+	if(k >= n)
+	{
+		sort_pdq(a, n);
+		return;
+	}
+	if(!k)
+		return;
+	select_nth(a, n, k - 1);
+	sort_pdq(a, k - 1);
+}
+
+// ====================================
+// Streaming top-k: the k smallest items seen so far in a max-heap of k
+// items (fixDown of the heap sort). An item not less than the top is
+// dropped with a single comparison, so for k << n the cost is ~n
+// comparisons and O(k) memory, and the input needs not be in memory.
+template<class Item>
+class CTopK
+{
+public:
+	CTopK(size_t f_k): m_k(f_k) { m_heap.reserve(f_k); }
+
+	void push(const Item& f_item)
+	{
+		if(m_heap.size() < m_k)
+		{
+			m_heap.push_back(f_item);
+			if(m_heap.size() == m_k)
+			{
+				for(size_t i = m_k / 2 - 1; i < m_k; --i)
+					fixDown(i, &m_heap[0], m_k);
+			}
+		}
+		else if(m_k && f_item < m_heap[0])
+		{
+			m_heap[0] = f_item;
+			fixDown(0, &m_heap[0], m_k);
+		}
+	}
+
+	size_t size() const { return m_heap.size(); }
+
+	// The largest of the k smallest (valid once k items are pushed)
+	const Item& top() const { return m_heap[0]; }
+
+	// The items kept, in ascending order
+	std::vector<Item> sorted() const
+	{
+		std::vector<Item> r(m_heap);
+		if(!r.empty())
+			sort_pdq(&r[0], r.size());
+		return r;
+	}
+
+private:
+	size_t m_k;
+	std::vector<Item> m_heap;
+};
+
+// The k smallest items of a[0, n) in ascending order to out[0, min(k, n))
+template<class Item>
+void select_top(const Item* a, size_t n, size_t k, Item* out)
+{
+	CTopK<Item> top(k);
+	for(size_t i = 0; i < n; i++)
+		top.push(a[i]);
+	std::vector<Item> r = top.sorted();
+	for(size_t i = 0; i < r.size(); i++)
+		out[i] = r[i];
+}
+
+#endif // __SELECT_H__
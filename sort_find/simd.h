@@ -0,0 +1,372 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+// Sorting networks and the in-register merge need AVX2 (8 lanes) or
+// SSE4.1 (4 lanes); define SORT_NO_SIMD to build the scalar leaves only
+#if !defined(SORT_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define SORT_SIMD_LANES 8
+#elif !defined(SORT_NO_SIMD) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#define SORT_SIMD_LANES 4
+#endif
+
+
+// The largest range sorted by sort_network
+enum { SimdNetworkMax = 64 };
+
+template<class T> struct simd_sortable: std::false_type {};
+// Items whose equal values are indistinguishable: the networks and the
+// in-register merge may serve the stable sorts too. Not floats: -0.0 and
+// +0.0 are equal but not the same.
+template<class T> struct simd_stable: std::false_type {};
+
+#ifdef SORT_SIMD_LANES
+template<> struct simd_sortable<int>: std::true_type {};
+template<> struct simd_sortable<float>: std::true_type {};
+template<> struct simd_stable<int>: std::true_type {};
+
+// ====================================
+// Registers: load/store, reverse, minmax(a, b) leaving the lane-wise smaller
+// items in a and the larger ones in b, and exchange<J, Mask> comparing every
+// lane i with the lane i ^ J, the lanes set in Mask keep the larger item.
+// The float ones blend on a strict compare instead of min/max: those return
+// the second operand of equal items, so a -0.0/+0.0 pair would come out as
+// two copies of one of them. Every lane keeps one of its two items.
+template<class T> struct SimdVec;
+
+#if SORT_SIMD_LANES == 8
+template<>
+struct SimdVec<int>
+{
+	typedef __m256i reg;
+	enum { Lanes = 8 };
+
+	static reg load(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static void store(int* p, reg v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static reg min(reg a, reg b) { return _mm256_min_epi32(a, b); }
+	static reg max(reg a, reg b) { return _mm256_max_epi32(a, b); }
+	static reg reverse(reg v) { return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)); }
+	static void minmax(reg& a, reg& b)
+	{
+		reg lo = min(a, b);
+		b = max(a, b);
+		a = lo;
+	}
+
+	template<int J, int Mask>
+	static reg exchange(reg v)
+	{
+		reg p = (J == 1) ? _mm256_shuffle_epi32(v, 0xB1) :
+				(J == 2) ? _mm256_shuffle_epi32(v, 0x4E) :
+				_mm256_permute2x128_si256(v, v, 1);
+		return _mm256_blend_epi32(min(v, p), max(v, p), Mask);
+	}
+};
+
+template<>
+struct SimdVec<float>
+{
+	typedef __m256 reg;
+	enum { Lanes = 8 };
+
+	static reg load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+	static reg reverse(reg v) { return _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)); }
+	static void minmax(reg& a, reg& b)
+	{
+		reg swap = _mm256_cmp_ps(b, a, _CMP_LT_OQ);
+		reg lo = _mm256_blendv_ps(a, b, swap);
+		b = _mm256_blendv_ps(b, a, swap);
+		a = lo;
+	}
+
+	template<int J, int Mask>
+	static reg exchange(reg v)
+	{
+		reg p = (J == 1) ? _mm256_permute_ps(v, 0xB1) :
+				(J == 2) ? _mm256_permute_ps(v, 0x4E) :
+				_mm256_permute2f128_ps(v, v, 1);
+		// A lane takes the item of its partner if it is smaller (larger for Mask)
+		reg take = _mm256_blend_ps(_mm256_cmp_ps(p, v, _CMP_LT_OQ), _mm256_cmp_ps(v, p, _CMP_LT_OQ), Mask);
+		return _mm256_blendv_ps(v, p, take);
+	}
+};
+#else
+// 32-bit lane mask to 16-bit lane mask for _mm_blend_epi16
+constexpr int simd_mask16(int m, int i = 0)
+{
+	return (i == 4) ? 0 : (((m >> i) & 1) * (3 << (2 * i))) | simd_mask16(m, i + 1);
+}
+
+template<>
+struct SimdVec<int>
+{
+	typedef __m128i reg;
+	enum { Lanes = 4 };
+
+	static reg load(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static void store(int* p, reg v) { _mm_storeu_si128((__m128i*)p, v); }
+	static reg min(reg a, reg b) { return _mm_min_epi32(a, b); }
+	static reg max(reg a, reg b) { return _mm_max_epi32(a, b); }
+	static reg reverse(reg v) { return _mm_shuffle_epi32(v, 0x1B); }
+	static void minmax(reg& a, reg& b)
+	{
+		reg lo = min(a, b);
+		b = max(a, b);
+		a = lo;
+	}
+
+	template<int J, int Mask>
+	static reg exchange(reg v)
+	{
+		reg p = (J == 1) ? _mm_shuffle_epi32(v, 0xB1) : _mm_shuffle_epi32(v, 0x4E);
+		return _mm_blend_epi16(min(v, p), max(v, p), simd_mask16(Mask));
+	}
+};
+
+template<>
+struct SimdVec<float>
+{
+	typedef __m128 reg;
+	enum { Lanes = 4 };
+
+	static reg load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+	static reg reverse(reg v) { return _mm_shuffle_ps(v, v, 0x1B); }
+	static void minmax(reg& a, reg& b)
+	{
+		reg swap = _mm_cmplt_ps(b, a);
+		reg lo = _mm_blendv_ps(a, b, swap);
+		b = _mm_blendv_ps(b, a, swap);
+		a = lo;
+	}
+
+	template<int J, int Mask>
+	static reg exchange(reg v)
+	{
+		reg p = (J == 1) ? _mm_shuffle_ps(v, v, 0xB1) : _mm_shuffle_ps(v, v, 0x4E);
+		// A lane takes the item of its partner if it is smaller (larger for Mask)
+		reg take = _mm_blend_ps(_mm_cmplt_ps(p, v), _mm_cmplt_ps(v, p), Mask);
+		return _mm_blendv_ps(v, p, take);
+	}
+};
+#endif
+
+// ====================================
+// Bitonic sorting network over R registers (N = R * Lanes items), unrolled
+// at compile time by template recursion the way static_for does it
+// (cpp/static_for.cpp): stages K = 2, 4, .. N, steps J = K / 2, .. 1.
+// Item p is compared with item p ^ J; the lower one takes the smaller item
+// if (p & K) == 0. Steps with J >= Lanes compare whole registers, the
+// others shuffle lanes within every register.
+
+// Lanes of the register starting at item g which take the larger item
+constexpr int bitonic_mask(int g, int k, int j, int lanes, int i = 0)
+{
+	return (i == lanes) ? 0 :
+		(((((g + i) & j) != 0) != (((g + i) & k) != 0)) << i) | bitonic_mask(g, k, j, lanes, i + 1);
+}
+
+// Step J of stage K for the registers [I, R)
+template<class V, int R, int K, int J, int I = 0, bool InRegister = (J < V::Lanes), bool End = (I == R)>
+struct bitonic_step
+{
+	static void run(typename V::reg* v)
+	{
+		enum { D = J / V::Lanes };
+		if(!(I & D))
+		{
+			typename V::reg lo = v[I];
+			typename V::reg hi = v[I + D];
+			V::minmax(lo, hi);
+			bool asc = !((I * V::Lanes) & K);
+			v[I] = asc ? lo : hi;
+			v[I + D] = asc ? hi : lo;
+		}
+		bitonic_step<V, R, K, J, I + 1>::run(v);
+	}
+};
+
+template<class V, int R, int K, int J, int I>
+struct bitonic_step<V, R, K, J, I, true, false>
+{
+	static void run(typename V::reg* v)
+	{
+		v[I] = V::template exchange<J, bitonic_mask(I * V::Lanes, K, J, V::Lanes)>(v[I]);
+		bitonic_step<V, R, K, J, I + 1>::run(v);
+	}
+};
+
+template<class V, int R, int K, int J, int I, bool InRegister>
+struct bitonic_step<V, R, K, J, I, InRegister, true>
+{
+	static void run(typename V::reg*) {}
+};
+
+// All the steps of stage K: sorts the bitonic sequences of K items
+template<class V, int R, int K, int J = K / 2>
+struct bitonic_merge
+{
+	static void run(typename V::reg* v)
+	{
+		bitonic_step<V, R, K, J>::run(v);
+		bitonic_merge<V, R, K, J / 2>::run(v);
+	}
+};
+
+template<class V, int R, int K>
+struct bitonic_merge<V, R, K, 0>
+{
+	static void run(typename V::reg*) {}
+};
+
+template<class V, int R, int K = 2, bool End = (K > R * V::Lanes)>
+struct bitonic_sort
+{
+	static void run(typename V::reg* v)
+	{
+		bitonic_merge<V, R, K>::run(v);
+		bitonic_sort<V, R, K * 2>::run(v);
+	}
+};
+
+template<class V, int R, int K>
+struct bitonic_sort<V, R, K, true>
+{
+	static void run(typename V::reg*) {}
+};
+
+// ====================================
+// Sort n <= R * Lanes items; a partial range is padded with the largest value
+template<class T, int R>
+static void sort_network_regs(T* a, size_t n)
+{
+	typedef SimdVec<T> V;
+	enum { L = V::Lanes, N = R * L };
+
+	typename V::reg v[R];
+	T buf[N];
+	T* p = a;
+	if(n < N)
+	{
+		const T pad = std::numeric_limits<T>::has_infinity ?
+			std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+		for(size_t i = 0; i < N; i++)
+			buf[i] = (i < n) ? a[i] : pad;
+		p = buf;
+	}
+
+	for(int r = 0; r < R; r++)
+		v[r] = V::load(p + r * L);
+	bitonic_sort<V, R>::run(v);
+	for(int r = 0; r < R; r++)
+		V::store(p + r * L, v[r]);
+
+	if(p != a)
+		for(size_t i = 0; i < n; i++)
+			a[i] = buf[i];
+}
+
+template<class T>
+void sort_network(T* a, size_t n)
+{
+	enum { L = SimdVec<T>::Lanes };
+	if(n < 2)
+		return;
+	if(n <= L)
+		sort_network_regs<T, 1>(a, n);
+	else if(n <= 2 * L)
+		sort_network_regs<T, 2>(a, n);
+	else if(n <= 4 * L)
+		sort_network_regs<T, 4>(a, n);
+	else if(n <= 8 * L)
+		sort_network_regs<T, 8>(a, n);
+	else
+		sort_network_regs<T, SimdNetworkMax / L>(a, n);
+}
+
+// ====================================
+// Merge of two sorted runs a register at a time: the register holding
+// the larger half of the last merge is merged with the next block of the
+// run whose head is smaller (the bitonic merge of a block and a reversed
+// block), the smaller half goes out. The first run to have less than a
+// register left is padded once with the largest value, so that a skewed
+// merge keeps going a register at a time: the pads sort last and are cut
+// off at the end of dst. The rest is merged one item at a time, the last
+// run moved as a block. Equal ints are indistinguishable, so the order of
+// the equal items (and the pads) does not matter.
+template<class T>
+void merge_runs_simd(const T* a, size_t na, const T* b, size_t nb, T* dst)
+{
+	typedef SimdVec<T> V;
+	enum { L = V::Lanes };
+
+	const T* ae = a + na;
+	const T* be = b + nb;
+	T* de = dst + na + nb;
+	T tmp[L];
+	T pad[L];
+	const T* t = tmp;
+	const T* te = tmp;
+
+	if(na >= L && nb >= L)
+	{
+		typename V::reg v[2];
+		v[1] = V::load(a);
+		a += L;
+		bool padded = false;
+		for(const T** next = &b;;)
+		{
+			v[0] = V::reverse(V::load(*next));
+			*next += L;
+			bitonic_merge<V, 2, 2 * L>::run(v);
+			V::store(dst, v[0]);
+			dst += L;
+
+			next = (b == be || (a != ae && *a < *b)) ? &a : &b;
+			const T** end = (next == &a) ? &ae : &be;
+			size_t left = *end - *next;
+			if(left < L)
+			{
+				if(!left || padded)
+					break;
+				std::copy(*next, *end, pad);
+				std::fill(pad + left, pad + L, std::numeric_limits<T>::max());
+				*next = pad;
+				*end = pad + L;
+				padded = true;
+			}
+		}
+		V::store(tmp, v[1]);
+		te = tmp + L;
+	}
+
+	// The rest of a, b and the last register
+	while(dst != de)
+	{
+		if(t == te && (a == ae || b == be))
+		{
+			const T* r = (a != ae) ? a : b;
+			std::copy(r, r + (de - dst), dst);
+			break;
+		}
+
+		const T** p = NULL;
+		if(t != te)
+			p = &t;
+		if(a != ae && (!p || *a < **p))
+			p = &a;
+		if(b != be && (!p || *b < **p))
+			p = &b;
+		*dst++ = *(*p)++;
+	}
+}
+#endif // SORT_SIMD_LANES
+
+#endif // __SIMD_H__